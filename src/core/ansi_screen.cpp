@@ -0,0 +1,132 @@
+/*
+ * Minbif - IRC instant messaging gateway
+ * Copyright(C) 2009-2010 Romain Bignon
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <glib.h>
+#include <cstring>
+
+#include "core/ansi_screen.h"
+#include "core/util.h"
+
+AnsiScreen::AnsiScreen()
+	: width(0),
+	  height(0)
+{}
+
+void AnsiScreen::reset()
+{
+	width = height = 0;
+	cells.clear();
+}
+
+void AnsiScreen::appendColors(string& out, uint8_t fg, uint8_t bg)
+{
+	/* libcaca colors are in the BGR order, ANSI ones in RGB. */
+	static const unsigned ansi[] = { 0, 4, 2, 6, 1, 5, 3, 7 };
+
+	out += "\033[0";
+	if(fg < 16)
+		out += ";" + t2s(fg < 8 ? 30 + ansi[fg] : 90 + ansi[fg - 8]);
+	if(bg < 16)
+		out += ";" + t2s(bg < 8 ? 40 + ansi[bg] : 100 + ansi[bg - 8]);
+	out += "m";
+}
+
+void AnsiScreen::appendChar(string& out, uint32_t ch)
+{
+	if(ch < 0x20 || !g_unichar_validate(ch))
+		ch = ' ';
+
+	gchar utf8[6];
+	out.append(utf8, g_unichar_to_utf8(ch, utf8));
+}
+
+string AnsiScreen::update(const string& grid)
+{
+	uint32_t size[2];
+	if(grid.size() < sizeof size)
+		return "";
+	memcpy(size, grid.data(), sizeof size);
+	if(grid.size() != sizeof size + (size_t)size[0] * size[1] * sizeof(CacaImage::Cell))
+		return "";
+
+	vector<CacaImage::Cell> next(size[0] * size[1]);
+	if(!next.empty())
+		memcpy(&next[0], grid.data() + sizeof size, next.size() * sizeof(CacaImage::Cell));
+
+	string out;
+	bool full = size[0] != width || size[1] != height;
+	if(full)
+		out = "\033[0m\033[2J";
+
+	width = size[0];
+	height = size[1];
+
+	int fg = -1, bg = -1;
+	unsigned cur_x = 0, cur_y = 0;
+	bool placed = false;     /**< cursor position is known */
+
+	for(unsigned y = 0; y < height; ++y)
+		for(unsigned x = 0; x < width; ++x)
+		{
+			const CacaImage::Cell& cell = next[y * width + x];
+			if(!full)
+			{
+				const CacaImage::Cell& old = cells[y * width + x];
+				if(old.ch == cell.ch && old.fg == cell.fg && old.bg == cell.bg)
+					continue;
+			}
+
+			if(placed && cur_y == y && x > cur_x && x - cur_x <= MAX_SKIP)
+			{
+				/* Rewriting a few unchanged cells is shorter
+				 * than moving the cursor. */
+				for(; cur_x < x; ++cur_x)
+				{
+					const CacaImage::Cell& skip = next[y * width + cur_x];
+					if(skip.fg != fg || skip.bg != bg)
+					{
+						appendColors(out, skip.fg, skip.bg);
+						fg = skip.fg;
+						bg = skip.bg;
+					}
+					appendChar(out, skip.ch);
+				}
+			}
+			else if(!placed || cur_y != y || cur_x != x)
+				out += "\033[" + t2s(y + 1) + ";" + t2s(x + 1) + "H";
+
+			if(cell.fg != fg || cell.bg != bg)
+			{
+				appendColors(out, cell.fg, cell.bg);
+				fg = cell.fg;
+				bg = cell.bg;
+			}
+			appendChar(out, cell.ch);
+
+			placed = true;
+			cur_x = x + 1;
+			cur_y = y;
+		}
+
+	/* Leave the cursor below the picture. */
+	if(!out.empty())
+		out += "\033[0m\033[" + t2s(height + 1) + ";1H";
+
+	cells.swap(next);
+	return out;
+}
@@ -0,0 +1,63 @@
+/*
+ * Minbif - IRC instant messaging gateway
+ * Copyright(C) 2009-2010 Romain Bignon
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef ANSI_SCREEN_H
+#define ANSI_SCREEN_H
+
+#include <string>
+#include <vector>
+
+#include "core/caca_image.h"
+
+using std::string;
+using std::vector;
+
+/** Draw successive pictures on an ANSI terminal.
+ *
+ * It remembers the characters grid the terminal displays, and only
+ * redraws cells which changed since the previous picture, moving the
+ * cursor with ANSI sequences. Colors are only set when they change.
+ */
+class AnsiScreen
+{
+	unsigned width, height;
+	vector<CacaImage::Cell> cells;
+
+	static const unsigned MAX_SKIP = 4;  /**< cells rewritten rather than jumped over */
+
+	static void appendColors(string& out, uint8_t fg, uint8_t bg);
+	static void appendChar(string& out, uint32_t ch);
+
+public:
+
+	AnsiScreen();
+
+	/** Get the sequence which changes the terminal from the
+	 * previous picture to this one.
+	 *
+	 * @param grid  picture rendered with the CacaImage::CELLS type
+	 * @return  data to send, empty if nothing changed.
+	 */
+	string update(const string& grid);
+
+	/** Forget what the terminal displays, the next picture is
+	 * fully drawn. */
+	void reset();
+};
+
+#endif /* ANSI_SCREEN_H */
@@ -16,22 +16,30 @@
  */
 
 #include <cstdlib>
+#include <ctime>
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <sys/stat.h>
 #ifdef HAVE_CACA
 	#include <caca.h>
 	#include <Imlib2.h>
 #endif
 
 #include "caca_image.h"
+#include "util.h"
+#include "mutex.h"
 #include <string.h>
 
 #ifdef HAVE_CACA
+	/* Imlib2 uses a global context. */
+	static Mutex imlib_mutex;
+
 	struct CacaImage::image
 	{
 		char *pixels;
 		unsigned int w, h;
 		cucul_dither_t *dither;
-		void *priv;
+		Mutex lock;      /**< dithering changes the dither state */
 		unsigned ref;
 
 		image();
@@ -42,6 +50,87 @@
 	};
 #endif /* HAVE_CACA */
 
+string CacaImage::cache_dir;
+const char* CacaImage::CELLS = "cells";
+
+#ifdef HAVE_CACA
+static string export_cells(cucul_canvas_t* cv, unsigned width, unsigned height)
+{
+	uint32_t size[2] = { width, height };
+	string out((const char*)size, sizeof size);
+	out.reserve(sizeof size + width * height * sizeof(CacaImage::Cell));
+
+	for(unsigned y = 0; y < height; ++y)
+		for(unsigned x = 0; x < width; ++x)
+		{
+			CacaImage::Cell cell;
+			memset(&cell, 0, sizeof cell);  /* padding goes in the cache */
+			cell.ch = cucul_get_char(cv, x, y);
+
+			uint32_t attr = cucul_get_attr(cv, x, y);
+			cell.fg = cucul_attr_to_ansi_fg(attr);
+			cell.bg = cucul_attr_to_ansi_bg(attr);
+			out.append((const char*)&cell, sizeof cell);
+		}
+	return out;
+}
+#endif /* HAVE_CACA */
+
+void CacaImage::setCacheDir(const string& dir)
+{
+	if(g_mkdir_with_parents(dir.c_str(), 0700) < 0)
+	{
+		cache_dir.clear();
+		return;
+	}
+	cache_dir = dir;
+
+	/* Forget pictures of icons which are not used anymore. */
+	GDir* d = g_dir_open(dir.c_str(), 0, NULL);
+	if(!d)
+		return;
+
+	time_t now = time(NULL);
+	const gchar* name;
+	while((name = g_dir_read_name(d)) != NULL)
+	{
+		string file = dir + "/" + name;
+		struct stat st;
+		if(g_stat(file.c_str(), &st) == 0 && st.st_mtime + CACHE_TTL < now)
+			g_unlink(file.c_str());
+	}
+	g_dir_close(d);
+}
+
+string CacaImage::getCacheFile(unsigned _width, unsigned _height, const char* output_type, unsigned _font_width, unsigned _font_height)
+{
+	if(cache_dir.empty() || path.empty())
+		return "";
+
+	if(hash.empty())
+	{
+		/* libpurple already names icons from their SHA-1. */
+		string name = path.substr(path.rfind('/') + 1);
+		name = name.substr(0, name.find('.'));
+		if(name.size() == 40 && name.find_first_not_of("0123456789abcdef") == string::npos)
+			hash = name;
+		else
+		{
+			gchar* data;
+			gsize len;
+			if(!g_file_get_contents(path.c_str(), &data, &len, NULL))
+				return "";
+			gchar* sum = g_compute_checksum_for_data(G_CHECKSUM_SHA1, (const guchar*)data, len);
+			hash = sum;
+			g_free(sum);
+			g_free(data);
+		}
+	}
+
+	return cache_dir + "/" + hash + "-" + t2s(_width) + "x" + t2s(_height) +
+	       "-" + t2s(_font_width) + "x" + t2s(_font_height) + "." + output_type;
+}
+
 CacaImage::CacaImage()
 	: width(0),
 	  height(0),
@@ -50,16 +139,14 @@ CacaImage::CacaImage()
 	  img(0)
 {}
 
-CacaImage::CacaImage(string path)
+CacaImage::CacaImage(string _path)
 	: width(0),
 	  height(0),
 	  font_width(6),
 	  font_height(10),
-	  img(NULL)
+	  img(NULL),
+	  path(_path)
 {
-#ifdef HAVE_CACA
-	img = image::load_file(path.c_str());
-#endif
 }
 
 CacaImage::CacaImage(const void* buf, size_t size, unsigned buf_width, unsigned buf_height, unsigned bpp)
@@ -70,10 +157,15 @@ CacaImage::CacaImage(const void* buf, size_t size, unsigned buf_width, unsigned
 	  img(NULL)
 {
 #ifdef HAVE_CACA
+	/* Do not read out of a truncated frame. */
+	if(size < (size_t)buf_width * buf_height * (bpp / 8))
+		return;
+
 	img = new image();
 	img->w = buf_width;
 	img->h = buf_height;
-	img->pixels = g_strndup((const char*)buf, size);
+	img->pixels = (char*)malloc(size);
+	memcpy(img->pixels, buf, size);
 
 	img->create_dither(bpp);
 #endif
@@ -81,14 +173,18 @@ CacaImage::CacaImage(const void* buf, size_t size, unsigned buf_width, unsigned
 
 CacaImage::CacaImage(const CacaImage& caca)
 	: buf(caca.buf),
+	  buf_type(caca.buf_type),
 	  width(caca.width),
 	  height(caca.height),
 	  font_width(caca.font_width),
 	  font_height(caca.font_height),
-	  img(caca.img)
+	  img(caca.img),
+	  path(caca.path),
+	  hash(caca.hash)
 {
 #ifdef HAVE_CACA
-	img->ref++;
+	if(img)
+		img->ref++;
 #endif
 }
 
@@ -96,13 +192,17 @@ CacaImage& CacaImage::operator=(const CacaImage& caca)
 {
 	deinit();
 	buf = caca.buf;
+	buf_type = caca.buf_type;
 	width = caca.width;
 	height = caca.height;
 	font_width = caca.font_width;
 	font_height = caca.font_height;
 	img = caca.img;
+	path = caca.path;
+	hash = caca.hash;
 #ifdef HAVE_CACA
-	img->ref++;
+	if(img)
+		img->ref++;
 #endif
 	return *this;
 }
@@ -132,19 +232,43 @@ string CacaImage::getIRCBuffer()
 	return buf;
 }
 
+bool CacaImage::getCachedBuffer(unsigned _width, unsigned _height, const char *output_type, unsigned _font_width, unsigned _font_height)
+{
+	if(buf.empty() == false && buf_type == output_type &&
+	   width == _width && height == _height &&
+	   font_width == _font_width && font_height == _font_height)
+		return true;
+
+	string cache_file = getCacheFile(_width, _height, output_type, _font_width, _font_height);
+	gchar* cached;
+	gsize len;
+	if(cache_file.empty() || !g_file_get_contents(cache_file.c_str(), &cached, &len, NULL))
+		return false;
+
+	width = _width;
+	height = _height;
+	font_width = _font_width;
+	font_height = _font_height;
+	buf.assign(cached, len);
+	buf_type = output_type;
+	g_free(cached);
+	return true;
+}
+
 string CacaImage::getIRCBuffer(unsigned _width, unsigned _height, const char *output_type, unsigned _font_width, unsigned _font_height)
 {
 #ifndef HAVE_CACA
 	throw CacaNotLoaded();
 #else
+	string cache_file = getCacheFile(_width, _height, output_type, _font_width, _font_height);
+	if(getCachedBuffer(_width, _height, output_type, _font_width, _font_height))
+		return buf;
+
+	if(!img && !path.empty())
+		img = image::load_file(path.c_str());
 	if(!img)
 		throw CacaError();
 
-	if(buf.empty() == false &&
-	   width == _width && height == _height &&
-	   font_width == _font_width && font_height == _font_height)
-		return buf;
-
 	width = _width;
 	height = _height;
 	font_width = _font_width;
@@ -167,32 +291,46 @@ string CacaImage::getIRCBuffer(unsigned _width, unsigned _height, const char *ou
 	cucul_set_canvas_size(cv, width, height);
 	cucul_set_color_ansi(cv, CUCUL_DEFAULT, CUCUL_TRANSPARENT);
 	cucul_clear_canvas(cv);
-	if(cucul_set_dither_algorithm(img->dither, "fstein"))
 	{
-		cucul_free_canvas(cv);
-		throw CacaError();
+		BlockLockMutex lock(&img->lock);
+		if(cucul_set_dither_algorithm(img->dither, "fstein"))
+		{
+			cucul_free_canvas(cv);
+			throw CacaError();
+		}
+
+		cucul_dither_bitmap(cv, 0, 0, width, height, img->dither, img->pixels);
 	}
 
-	cucul_dither_bitmap(cv, 0, 0, width, height, img->dither, img->pixels);
-
-	size_t len;
-	char* tmp;
+	if(!strcmp(output_type, CELLS))
+		buf = export_cells(cv, width, height);
+	else
+	{
+		size_t len;
+		char* tmp;
 #ifdef HAVE_OLD_CACA
-	tmp = (char*)cucul_export_memory(cv, output_type, &len);
+		tmp = (char*)cucul_export_memory(cv, output_type, &len);
 #else
-	tmp = (char*)caca_export_canvas_to_memory(cv, output_type, &len);
+		tmp = (char*)caca_export_canvas_to_memory(cv, output_type, &len);
 #endif
-	if(!tmp)
-		throw CacaError();
-
-	tmp = (char*)realloc(tmp, len+1);
-	tmp[len] = 0;
-	buf = tmp;
-
-	free(tmp);
+		if(!tmp)
+		{
+			cucul_free_canvas(cv);
+			throw CacaError();
+		}
+
+		buf.assign(tmp, len);
+		free(tmp);
+	}
+	buf_type = output_type;
 
 	cucul_free_canvas(cv);
 
+	/* Written in a temporary file then renamed, so a concurrent
+	 * lookup never reads a partial picture. */
+	if(!cache_file.empty())
+		g_file_set_contents(cache_file.c_str(), buf.data(), buf.size(), NULL);
+
 	return buf;
 #endif /* HAVE_CACA */
 }
@@ -203,15 +341,12 @@ CacaImage::image::image()
 	  w(0),
 	  h(0),
 	  dither(0),
-	  priv(0),
 	  ref(1)
 {
 }
 
 CacaImage::image::~image()
 {
-	if(priv)
-		imlib_free_image();
 	if(dither)
 		cucul_free_dither(dither);
 	free(pixels);
@@ -237,6 +372,7 @@ struct CacaImage::image* CacaImage::image::load_file(char const * name)
 	struct image * im = new image();
 
 	Imlib_Image image;
+	BlockLockMutex lock(&imlib_mutex);
 
 	/* Load the new image */
 	image = imlib_load_image(name);
@@ -247,11 +383,14 @@ struct CacaImage::image* CacaImage::image::load_file(char const * name)
 		return NULL;
 	}
 
+	/* Pixels are copied, so the Imlib image can be freed now, while
+	 * the context is locked. */
 	imlib_context_set_image(image);
 	im->w = imlib_image_get_width();
 	im->h = imlib_image_get_height();
 	im->pixels = (char*)malloc(im->w * im->h * 4);
 	memcpy(im->pixels, imlib_image_get_data_for_reading_only(), im->w * im->h * 4);
+	imlib_free_image();
 
 	im->create_dither(32);
 	if(!im->dither)
@@ -260,8 +399,6 @@ struct CacaImage::image* CacaImage::image::load_file(char const * name)
 		return NULL;
 	}
 
-	im->priv = (void *)image;
-
 	return im;
 }
 
@@ -20,6 +20,7 @@
 
 #include <string>
 #include <exception>
+#include <stdint.h>
 
 using std::string;
 
@@ -29,23 +30,54 @@ class CacaError : public std::exception {};
 /** Raised when libcaca isn't loaded. */
 class CacaNotLoaded : public std::exception {};
 
-/** Convert an image (JPG/PNG/..) to a beautiful ASCII-art picture. */
+/** Convert an image (JPG/PNG/..) to a beautiful ASCII-art picture.
+ *
+ * Pictures rendered from a file are stored in the cache directory, in
+ * a file named from the image content hash and the render parameters,
+ * so the image is only decoded and dithered the first time.
+ */
 class CacaImage
 {
 	struct image;
 
 	string buf;
+	string buf_type;
 	unsigned width, height, font_width, font_height;
 	image* img;
+	string path;     /**< file decoded on first render, if any */
+	string hash;     /**< hash of file content */
+
+	static string cache_dir;
+	static const time_t CACHE_TTL = 30 * 24 * 3600;  /**< s */
 
 	void deinit();
+	string getCacheFile(unsigned width, unsigned height, const char* output_type, unsigned font_width, unsigned font_height);
 
 public:
 
+	/** Output type of getIRCBuffer() giving the raw characters grid:
+	 * width and height as uint32_t, then one Cell per character, line
+	 * by line. See AnsiScreen.
+	 */
+	static const char* CELLS;
+
+	struct Cell
+	{
+		uint32_t ch;    /**< unicode character */
+		uint8_t fg, bg; /**< ANSI colors (0-15), or more than 15 for default */
+	};
+
+	/** Set the directory where rendered pictures are cached, and
+	 * remove old ones.
+	 */
+	static void setCacheDir(const string& dir);
+
 	/** Empty constructor */
 	CacaImage();
 
 	/** Constructor from file.
+	 *
+	 * The file is only read when the picture isn't in the cache.
 	 *
 	 * @param path  path to file
 	 */
@@ -60,6 +92,15 @@ public:
 
 	~CacaImage();
 
+	/** There is a picture to render. */
+	bool isValid() const { return img || !path.empty(); }
+
+	/** Check if the picture has already been rendered with these
+	 * parameters, in memory or in the cache directory. If so,
+	 * getIRCBuffer() returns it without rendering it again.
+	 */
+	bool getCachedBuffer(unsigned width, unsigned height = 0, const char* output_type = "irc", unsigned font_width = 6, unsigned font_height = 10);
+
 	/** Get IRC buffer to ASCII art picture.
 	 * If buffer is empty, it builds it.
 	 *
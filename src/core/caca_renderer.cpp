@@ -0,0 +1,213 @@
+/*
+ * Minbif - IRC instant messaging gateway
+ * Copyright(C) 2009-2010 Romain Bignon
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "core/caca_renderer.h"
+#include "core/util.h"
+#include "core/log.h"
+
+int CacaRenderer::jobs_fd[2] = { -1, -1 };
+int CacaRenderer::done_fd[2] = { -1, -1 };
+guint CacaRenderer::done_watch = 0;
+vector<GThread*> CacaRenderer::threads;
+set<CacaRenderer::Job*> CacaRenderer::jobs;
+
+CacaRenderer::Job::Job(const CacaImage& _image, unsigned _width, unsigned _height, const char* _output_type,
+                       void* _owner, void* _data, const string& _tag)
+	: image(_image),
+	  width(_width),
+	  height(_height),
+	  output_type(_output_type),
+	  failed(false),
+	  owner(_owner),
+	  callback(NULL),
+	  data(_data),
+	  tag(_tag)
+{
+}
+
+CacaRenderer::Job::~Job()
+{
+	delete callback;
+}
+
+void CacaRenderer::Job::render()
+{
+	try
+	{
+		buf = image.getIRCBuffer(width, height, output_type.c_str());
+	}
+	catch(CacaError&)
+	{
+		failed = true;
+	}
+	catch(CacaNotLoaded&)
+	{
+		failed = true;
+	}
+}
+
+bool CacaRenderer::start()
+{
+	if(!threads.empty())
+		return true;
+	if(jobs_fd[0] >= 0)
+		return false; /* Already failed. */
+
+	if(pipe(jobs_fd) < 0 || pipe(done_fd) < 0)
+	{
+		b_log[W_ERR] << "Unable to create render pipes: " << strerror(errno);
+		return false;
+	}
+	for(unsigned i = 0; i < 2; ++i)
+	{
+		fcntl(jobs_fd[i], F_SETFD, FD_CLOEXEC);
+		fcntl(done_fd[i], F_SETFD, FD_CLOEXEC);
+	}
+	fcntl(done_fd[0], F_SETFL, fcntl(done_fd[0], F_GETFL) | O_NONBLOCK);
+
+	done_watch = glib_input_add(done_fd[0], PURPLE_INPUT_READ, CacaRenderer::done_cb, NULL);
+
+	for(unsigned i = 0; i < THREADS; ++i)
+	{
+#if GLIB_CHECK_VERSION(2, 32, 0)
+		GThread* thread = g_thread_try_new("minbif-caca", CacaRenderer::run, NULL, NULL);
+#else
+		GThread* thread = g_thread_create(CacaRenderer::run, NULL, TRUE, NULL);
+#endif
+		if(!thread)
+			break;
+		threads.push_back(thread);
+	}
+
+	if(threads.empty())
+	{
+		b_log[W_ERR] << "Unable to start render threads, pictures are rendered in the main loop";
+		return false;
+	}
+
+	return true;
+}
+
+void CacaRenderer::enqueue(Job* job)
+{
+	jobs.insert(job);
+
+	ssize_t r = -1;
+	if(start())
+		while((r = write(jobs_fd[1], &job, sizeof job)) < 0 && errno == EINTR)
+			;
+
+	if(r != sizeof job)
+	{
+		/* No worker, render it now but still call back later, as
+		 * callers do not expect to be called before we return. */
+		job->render();
+		g_idle_add(CacaRenderer::done_idle, job);
+	}
+}
+
+gpointer CacaRenderer::run(gpointer)
+{
+	for(;;)
+	{
+		Job* job;
+		ssize_t r = read(jobs_fd[0], &job, sizeof job);
+		if(r < 0 && errno == EINTR)
+			continue;
+		if(r != sizeof job || !job)
+			break;
+
+		job->render();
+
+		while(write(done_fd[1], &job, sizeof job) < 0 && errno == EINTR)
+			;
+	}
+	return NULL;
+}
+
+void CacaRenderer::deliver(Job* job)
+{
+	if(jobs.erase(job) == 0)
+		return;
+
+	if(job->callback)
+		job->callback->run();
+	delete job;
+}
+
+void CacaRenderer::done_cb(gpointer, gint fd, PurpleInputCondition)
+{
+	Job* job;
+	while(read(fd, &job, sizeof job) == sizeof job)
+		deliver(job);
+}
+
+gboolean CacaRenderer::done_idle(gpointer data)
+{
+	deliver(static_cast<Job*>(data));
+	return FALSE;
+}
+
+void CacaRenderer::cancel(void* owner)
+{
+	for(set<Job*>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+		if((*it)->owner == owner)
+		{
+			delete (*it)->callback;
+			(*it)->callback = NULL;
+		}
+}
+
+void CacaRenderer::uninit()
+{
+	/* One stop order per worker. */
+	for(vector<GThread*>::iterator it = threads.begin(); it != threads.end(); ++it)
+	{
+		Job* stop = NULL;
+		while(write(jobs_fd[1], &stop, sizeof stop) < 0 && errno == EINTR)
+			;
+	}
+	for(vector<GThread*>::iterator it = threads.begin(); it != threads.end(); ++it)
+		g_thread_join(*it);
+	threads.clear();
+
+	if(done_watch > 0)
+		g_source_remove(done_watch);
+	done_watch = 0;
+
+	for(unsigned i = 0; i < 2; ++i)
+	{
+		if(jobs_fd[i] >= 0)
+			close(jobs_fd[i]);
+		if(done_fd[i] >= 0)
+			close(done_fd[i]);
+		jobs_fd[i] = done_fd[i] = -1;
+	}
+
+	/* Workers are stopped, so nobody uses the remaining jobs. An
+	 * idle delivery may still be pending, but deliver() ignores
+	 * jobs it does not know. */
+	for(set<Job*>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+		delete *it;
+	jobs.clear();
+}
@@ -0,0 +1,134 @@
+/*
+ * Minbif - IRC instant messaging gateway
+ * Copyright(C) 2009-2010 Romain Bignon
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef CACA_RENDERER_H
+#define CACA_RENDERER_H
+
+#include <glib.h>
+#include <string>
+#include <vector>
+#include <set>
+
+#include "core/caca_image.h"
+#include "core/callback.h"
+
+using std::string;
+using std::vector;
+using std::set;
+
+/** Render CacaImage pictures in a pool of worker threads.
+ *
+ * Decoding and dithering a large picture takes long enough to delay
+ * every IRC and IM traffic, so it is done out of the main loop. Jobs
+ * are given to workers through a pipe, and workers write finished
+ * jobs to another pipe watched by the main loop, which calls the
+ * callback.
+ *
+ * Jobs are only created, read and deleted from the main loop, and
+ * workers only touch the image and the buffer of the job they
+ * render.
+ */
+class CacaRenderer
+{
+public:
+
+	class Job
+	{
+		friend class CacaRenderer;
+
+		CacaImage image;
+		unsigned width, height;
+		string output_type;
+		string buf;
+		bool failed;
+		void* owner;
+		_CallBack* callback;
+		void* data;
+		string tag;
+
+		Job(const CacaImage& image, unsigned width, unsigned height, const char* output_type,
+		    void* owner, void* data, const string& tag);
+		~Job();
+
+		void render();
+
+	public:
+
+		/** Rendered picture. */
+		const string& getBuffer() const { return buf; }
+
+		/** Image can't be decoded. */
+		bool hasFailed() const { return failed; }
+
+		void* getData() const { return data; }
+		const string& getTag() const { return tag; }
+	};
+
+private:
+
+	static int jobs_fd[2];     /**< main loop -> workers */
+	static int done_fd[2];     /**< workers -> main loop */
+	static guint done_watch;
+	static vector<GThread*> threads;
+	static set<Job*> jobs;     /**< jobs not delivered yet */
+
+	static const unsigned THREADS = 2;
+
+	static bool start();
+	static void enqueue(Job* job);
+	static void deliver(Job* job);
+	static gpointer run(gpointer data);
+	static void done_cb(gpointer data, gint fd, PurpleInputCondition cond);
+	static gboolean done_idle(gpointer data);
+
+public:
+
+	/** Render a picture in background.
+	 *
+	 * The callback is called from the main loop with the job as
+	 * argument, which is deleted when the callback returns.
+	 *
+	 * @param image  picture to render
+	 * @param width  render's text width
+	 * @param height  render's text height
+	 * @param output_type  libcaca export format
+	 * @param obj  object the callback is called on
+	 * @param func  callback
+	 * @param data  user data, not freed
+	 * @param tag  user string
+	 */
+	template<typename T>
+	static void render(const CacaImage& image, unsigned width, unsigned height, const char* output_type,
+	                   T* obj, bool (T::*func)(void*), void* data = NULL, const string& tag = "")
+	{
+#ifndef HAVE_CACA
+		throw CacaNotLoaded();
+#endif
+		Job* job = new Job(image, width, height, output_type, obj, data, tag);
+		job->callback = new CallBack<T>(obj, func, job);
+		enqueue(job);
+	}
+
+	/** Do not call callbacks of this object anymore. */
+	static void cancel(void* owner);
+
+	/** Stop workers and forget every job. */
+	static void uninit();
+};
+
+#endif /* CACA_RENDERER_H */
@@ -75,7 +75,7 @@ Log::flux::~flux()
 		else
 			category = string("[") + all_flags[i].s + "] ";
 
-		if(b_log.getServerPoll())
+		if(b_log.getServerPoll() && b_log.inMainThread())
 			b_log.getServerPoll()->log(flag, category + str);
 
 	}
@@ -83,7 +83,8 @@ Log::flux::~flux()
 
 Log::Log()
 	: logged_flags(DEFAULT_LOGGED_FLAGS),
-	  poll(NULL)
+	  poll(NULL),
+	  main_thread(pthread_self())
 {
 	openlog("minbif", LOG_CONS, LOG_DAEMON);
 }
@@ -20,6 +20,7 @@
 
 #include <string>
 #include <stdint.h>
+#include <pthread.h>
 #include <sstream>
 #include "core/exception.h"
 
@@ -69,6 +70,9 @@ public:
 	void setServerPoll(const ServerPoll* _poll) { poll = _poll; }
 	const ServerPoll* getServerPoll() const { return poll; }
 
+	/** Messages logged by other threads are only sent to syslog. */
+	bool inMainThread() const { return pthread_equal(pthread_self(), main_thread); }
+
 	class flux
 	{
 		std::string str;
@@ -107,6 +111,7 @@ private:
 	uint32_t logged_flags;
 	bool to_syslog;
 	const ServerPoll* poll;
+	pthread_t main_thread;
 };
 
 template<>
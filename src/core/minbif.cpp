@@ -91,6 +91,12 @@ Minbif::Minbif()
 	section->AddItem(new ConfigItem_bool("dcc", "Send files to IRC user with DCC", "true"));
 	section->AddItem(new ConfigItem_string("dcc_own_ip", "Force minbif to always send DCC requests from a particular IP address", " "));
 	section->AddItem(new ConfigItem_intrange("port_range", "Port range to listen on for DCC", 1024, 65535, "1024-65535"));
+	section->AddItem(new ConfigItem_int("dcc_window", "Data sent with DCC before waiting for an ack (KB)", 1, 65535, "256"));
+	section->AddItem(new ConfigItem_bool("dcc_turbo", "Send files with turbo DCC (TSEND), without acks", "false"));
+	section->AddItem(new ConfigItem_bool("dcc_stream", "Stream received files to DCC without writting them on disk", "false"));
+	section->AddItem(new ConfigItem_int("user_bandwidth", "Maximum rate of files sent to a user with DCC (KB/s, 0 for no limit)", 0, 1048576, "0"));
+	section->AddItem(new ConfigItem_int("global_bandwidth", "Maximum rate of files sent to all users with DCC (KB/s, 0 for no limit)", 0, 1048576, "0"));
+	section->AddItem(new ConfigItem_bool("dcc_video_delta", "Only redraw changed characters of video sent with DCC CHAT", "false"));
 
 	section = conf.AddSection("logging", "Log information", MyConfig::NORMAL);
 	section->AddItem(new ConfigItem_string("level", "Logging level"));
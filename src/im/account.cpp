@@ -28,6 +28,8 @@
 #include "im/conversation.h"
 #include "im/buddy.h"
 #include "im/purple.h"
+#include "im/login_scheduler.h"
+#include "im/roomlist.h"
 #include "core/log.h"
 #include "core/version.h"
 #include "irc/irc.h"
@@ -37,6 +39,8 @@
 
 namespace im {
 
+map<PurpleAccount*, Account::JoinJob> Account::join_jobs;
+
 Account::Account()
 	: account(NULL)
 {}
@@ -398,6 +402,7 @@ void Account::setID(string id) const
 {
 	assert(isValid());
 	purple_account_set_ui_string(account, MINBIF_VERSION_NAME, "id", id.c_str());
+	Purple::invalidateAccounts();
 }
 
 string Account::getID(bool calculate_newone) const
@@ -437,6 +442,7 @@ void Account::setStatusChannelName(const string& c)
 
 	leaveStatusChannel();
 	purple_account_set_ui_string(account, MINBIF_VERSION_NAME, "channel", c.c_str());
+	Purple::invalidateAccounts();
 	createStatusChannel();
 }
 
@@ -455,19 +461,36 @@ void Account::flushChannelJoins()
 	assert(isValid());
 	string list = purple_account_get_ui_string(account, MINBIF_VERSION_NAME, "join_queue", "");
 	string cname;
-	while((cname = stringtok(list, ",")).empty() == false)
-		this->joinChat(cname, "");
+
 	purple_account_set_ui_string(account, MINBIF_VERSION_NAME, "join_queue", "");
+	if(list.empty())
+		return;
+
+	JoinJob& job = join_jobs[account];
+	if(job.channels.empty())
+	{
+		job.next = 0;
+		job.id = 0;
+	}
+	while((cname = stringtok(list, ",")).empty() == false)
+		job.channels.push_back(cname);
+
+	if(!job.id)
+		join_next(account);
 }
 
 void Account::abortChannelJoins()
 {
 	assert(isValid());
 
+	string list = purple_account_get_ui_string(account, MINBIF_VERSION_NAME, "join_queue", "");
+	vector<string> pending = takeChannelJoins();
+	for(vector<string>::iterator it = pending.begin(); it != pending.end(); ++it)
+		list += (list.empty() ? "" : ",") + *it;
+
 	if (isConnected())
 	{
 		irc::IRC* irc = Purple::getIM()->getIRC();
-		string list = purple_account_get_ui_string(account, MINBIF_VERSION_NAME, "join_queue", "");
 		string cname;
 
 		while((cname = stringtok(list, ",")).empty() == false)
@@ -481,6 +504,92 @@ void Account::abortChannelJoins()
 
 }
 
+vector<string> Account::takeChannelJoins()
+{
+	vector<string> pending;
+	map<PurpleAccount*, JoinJob>::iterator job = join_jobs.find(account);
+	if(job == join_jobs.end())
+		return pending;
+
+	pending.assign(job->second.channels.begin() + job->second.next, job->second.channels.end());
+	if(job->second.id)
+		g_source_remove(job->second.id);
+	join_jobs.erase(job);
+	return pending;
+}
+
+void Account::getJoinPace(const Protocol& proto, unsigned& batch, unsigned& interval)
+{
+	static const struct
+	{
+		const char* purple_id;
+		unsigned batch;
+		unsigned interval; /* ms */
+	} paces[] = {
+		{ "prpl-irc",    1, 1000 },
+		{ "prpl-jabber", 5,  500 },
+		{ NULL,          3, 1000 }
+	};
+
+	size_t i;
+	string id = proto.isValid() ? proto.getPurpleID() : "";
+	for(i = 0; paces[i].purple_id != NULL && id != paces[i].purple_id; ++i)
+		;
+
+	batch = paces[i].batch;
+	interval = paces[i].interval;
+}
+
+void Account::reportJoinProgress(const JoinJob& job) const
+{
+	irc::StatusChannel* chan = getStatusChannel();
+	if(!chan)
+		return;
+
+	irc::IRC* irc = Purple::getIM()->getIRC();
+	chan->broadcast(irc::Message(MSG_NOTICE).setSender(irc)
+						.setReceiver(chan)
+						.addArg("Rejoining channels on " + getID() + ": " +
+						        t2s(job.next) + "/" + t2s(job.channels.size())));
+}
+
+gboolean Account::join_next(void* data)
+{
+	Account acc((PurpleAccount*)data);
+	map<PurpleAccount*, JoinJob>::iterator it = join_jobs.find(acc.account);
+	if(it == join_jobs.end())
+		return FALSE;
+
+	JoinJob& job = it->second;
+	if(!acc.isConnected())
+	{
+		/* Keep channels for the next connection. */
+		vector<string> pending = acc.takeChannelJoins();
+		for(vector<string>::iterator c = pending.begin(); c != pending.end(); ++c)
+			acc.enqueueChannelJoin(*c);
+		return FALSE;
+	}
+
+	unsigned batch, interval;
+	getJoinPace(acc.proto, batch, interval);
+
+	for(unsigned i = 0; i < batch && job.next < job.channels.size(); ++i)
+		acc.joinChat(job.channels[job.next++], "");
+
+	if(job.channels.size() > batch)
+		acc.reportJoinProgress(job);
+
+	if(job.next >= job.channels.size())
+	{
+		join_jobs.erase(it);
+		return FALSE;
+	}
+
+	if(!job.id)
+		job.id = g_timeout_add(interval, Account::join_next, acc.account);
+	return TRUE;
+}
+
 string Account::getServername() const
 {
 	assert(isValid());
@@ -505,46 +614,30 @@ bool Account::isConnecting() const
 	return purple_account_is_connecting(account);
 }
 
-vector<Buddy> Account::getBuddies() const
+const set<Buddy>& Account::getBuddies() const
 {
 	assert(isValid());
-	vector<Buddy> buddies;
-	if(!purple_get_blist())
-		return buddies;
-
-	GSList* bl = purple_find_buddies(account, NULL);
-	GSList* cur;
-
-	for(cur = bl; cur != NULL; cur = cur->next)
-	{
-		if(!PURPLE_BLIST_NODE_IS_BUDDY((PurpleBlistNode*)cur->data))
-			continue;
-		PurpleBuddy* b = (PurpleBuddy*)cur->data;
-		buddies.push_back(Buddy(b));
-	}
-	g_slist_free(bl);
-
-	return buddies;
+	return Buddy::getAccountBuddies(account);
 }
 
 void Account::updatedAllBuddies() const
 {
 	assert(isValid());
-	vector<Buddy> buddies = getBuddies();
-	for(vector<Buddy>::iterator it = buddies.begin(); it != buddies.end(); ++it)
+	const set<Buddy>& buddies = getBuddies();
+	for(set<Buddy>::const_iterator it = buddies.begin(); it != buddies.end(); ++it)
 		it->updated();
 }
 
-void Account::displayRoomList() const
+void Account::displayRoomList(const string& filter, bool refresh) const
 {
 	assert(isValid());
-	purple_roomlist_get_list(account->gc);
+	RoomList::display(*this, RoomList::Filter(filter), refresh);
 }
 
 void Account::connect() const
 {
 	assert(isValid());
-	purple_account_set_enabled(account, MINBIF_VERSION_NAME, true);
+	LoginScheduler::enqueue(*this);
 }
 
 void Account::disconnect() const
@@ -557,32 +650,14 @@ void Account::disconnect() const
 int Account::delayReconnect() const
 {
 	assert(isValid());
-	int delay = purple_account_get_ui_int(account, MINBIF_VERSION_NAME, "delay-reconnect", 15);
-	delay *= 2;
-
-	int id = purple_account_get_ui_int(account, MINBIF_VERSION_NAME, "id-reconnect", -1);
-	if(id >= 0)
-		g_source_remove(id);
-	id = g_timeout_add(delay*1000, Account::reconnect, account);
-
-	purple_account_set_ui_int(account, MINBIF_VERSION_NAME, "delay-reconnect", delay);
-	purple_account_set_ui_int(account, MINBIF_VERSION_NAME, "id-reconnect", id);
-	return delay;
+	return LoginScheduler::retry(*this);
 }
 
 void Account::removeReconnection(bool verbose) const
 {
 	assert(isValid());
-	int id = purple_account_get_ui_int(account, MINBIF_VERSION_NAME, "id-reconnect", -1);
-	if(id >= 0)
-	{
-		g_source_remove(id);
-		if(verbose)
-			b_log[W_INFO|W_SNO] << "Abort auto-reconnection to " << getServername();
-	}
-
-	purple_account_set_ui_int(account, MINBIF_VERSION_NAME, "delay-reconnect", 15);
-	purple_account_set_ui_int(account, MINBIF_VERSION_NAME, "id-reconnect", -1);
+	if(LoginScheduler::cancel(*this) && verbose)
+		b_log[W_INFO|W_SNO] << "Abort auto-reconnection to " << getServername();
 }
 
 irc::StatusChannel* Account::getStatusChannel() const
@@ -634,8 +709,8 @@ void Account::createStatusChannel()
 
 	chan->addAccount(*this);
 
-	vector<Buddy> buddies = getBuddies();
-	for(vector<Buddy>::iterator b = buddies.begin(); b != buddies.end(); ++b)
+	const set<Buddy>& buddies = getBuddies();
+	for(set<Buddy>::const_iterator b = buddies.begin(); b != buddies.end(); ++b)
 		b->updated();
 }
 
@@ -650,8 +725,8 @@ void Account::leaveStatusChannel()
 
 	chan->removeAccount(*this);
 
-	vector<Buddy> buddies = getBuddies();
-	for(vector<Buddy>::iterator b = buddies.begin(); b != buddies.end(); ++b)
+	const set<Buddy>& buddies = getBuddies();
+	for(set<Buddy>::const_iterator b = buddies.begin(); b != buddies.end(); ++b)
 		if(b->getNick())
 			b->getNick()->part(chan, "Leaving status channel");
 
@@ -958,23 +1033,24 @@ void Account::uninit()
 	purple_accounts_set_ui_ops(NULL);
 	purple_connections_set_ui_ops(NULL);
 	purple_signals_disconnect_by_handle(getHandler());
-}
 
-gboolean Account::reconnect(void* data)
-{
-	Account acc((PurpleAccount*)data);
-	purple_account_set_ui_int(acc.account, MINBIF_VERSION_NAME, "id-reconnect", -1);
-	acc.connect();
-	return FALSE;
+	for(map<PurpleAccount*, JoinJob>::iterator it = join_jobs.begin(); it != join_jobs.end(); ++it)
+		if(it->second.id)
+			g_source_remove(it->second.id);
+	join_jobs.clear();
 }
 
 void Account::account_added(PurpleAccount* account)
 {
+	Purple::invalidateAccounts();
 }
 
 void Account::account_removed(PurpleAccount* a)
 {
+	Purple::invalidateAccounts();
+
 	Account account(a);
+	RoomList::clearCache(account);
 	account.abortChannelJoins();
 	account.removeReconnection();
 	account.leaveStatusChannel();
@@ -1186,11 +1262,17 @@ void Account::connecting(PurpleConnection *gc,
 void Account::connected(PurpleConnection* gc)
 {
 	Account account = Account(gc->account);
-	account.removeReconnection();
+	LoginScheduler::connected(account);
 	irc::IRC* irc = Purple::getIM()->getIRC();
 
 	b_log[W_INFO|W_SNO] << "Connection to " << account.getServername() << " established!";
 	irc->addServer(new irc::RemoteServer(irc, account));
+
+	/* Buddies are about to sign on all together. */
+	irc::StatusChannel* chan = account.getStatusChannel();
+	if(chan)
+		chan->startBurst();
+
 	account.flushChannelJoins();
 }
 
@@ -1199,6 +1281,11 @@ void Account::account_signed_on_cb(PurpleConnection *gc, gpointer event)
 	Account account = Account(gc->account);
 	GList* list = purple_get_chats();
 
+	/* Presences are usually received right after sign on. */
+	irc::StatusChannel* chan = account.getStatusChannel();
+	if(chan)
+		chan->startBurst();
+
 	/* Rejoin channels. */
 	for(; list; list = list->next)
 	{
@@ -1234,7 +1321,12 @@ void Account::disconnected(PurpleConnection* gc)
 	GList* list = purple_get_chats();
 	GList* next = NULL;
 
+	/* Channels not rejoined yet are kept for the next connection. */
+	vector<string> pending = account.takeChannelJoins();
 	account.abortChannelJoins();
+	for(vector<string>::iterator it = pending.begin(); it != pending.end(); ++it)
+		account.enqueueChannelJoin(*it);
+	LoginScheduler::disconnected(account);
 
 	/* Enqueue channels to auto-rejoin. */
 	for(; list; list = next)
@@ -1272,6 +1364,7 @@ void Account::disconnect_reason(PurpleConnection *gc,
 		b_log[W_ERR|W_SNO] << "Reconnection in " << acc.delayReconnect() << " seconds";
 		break;
 	default:
+		LoginScheduler::disconnected(acc);
 		break; /* Do not auto reconnect. */
 	}
 }
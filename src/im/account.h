@@ -23,6 +23,7 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <set>
 
 #include "im/protocol.h"
 
@@ -36,6 +37,7 @@ namespace im
 	using std::string;
 	using std::vector;
 	using std::map;
+	using std::set;
 	class Buddy;
 
 	/** This class represents an account.
@@ -79,7 +81,21 @@ namespace im
 		static void disconnect_reason(PurpleConnection *gc,
 		                              PurpleConnectionError reason,
 		                              const char *text);
-		static gboolean reconnect(void*);
+
+		/* Channels are rejoined after sign on a few at a time, to
+		 * not hit the server's flood limits. */
+		struct JoinJob
+		{
+			vector<string> channels;
+			size_t next;
+			guint id;
+		};
+		static map<PurpleAccount*, JoinJob> join_jobs;
+		static gboolean join_next(void*);
+		static void getJoinPace(const Protocol& proto, unsigned& batch, unsigned& interval);
+		void reportJoinProgress(const JoinJob& job) const;
+		/** Stop the rejoin job and return channels not joined yet. */
+		vector<string> takeChannelJoins();
 
 	public:
 
@@ -144,9 +160,13 @@ namespace im
 		string getStatusMessage(PurpleStatusPrimitive pri = PURPLE_STATUS_UNSET) const;
 
 		/** Get room list from this account.
-		 * The roomlist callbacks will be called.
+		 * The roomlist callbacks will be called, unless the list
+		 * is answered from cache.
+		 *
+		 * @param filter  ELIST filter (see RoomList::Filter)
+		 * @param refresh  do not use the cache
 		 */
-		void displayRoomList() const;
+		void displayRoomList(const string& filter = "", bool refresh = false) const;
 
 		/** Get name of IRC server linked to this account.
 		 *
@@ -167,7 +187,9 @@ namespace im
 		void enqueueChannelJoin(const string& c);
 
 		/** Try to join every channels in queue.
-		 * It also remove them from queue.
+		 * It also remove them from queue. Channels are joined by
+		 * batches, paced according to the protocol, and progress is
+		 * reported on the status channel.
 		 */
 		void flushChannelJoins();
 
@@ -190,8 +212,12 @@ namespace im
 		/** Call a command. */
 		bool callCommand(const string& command) const;
 
-		/** \todo TODO implement it */
-		vector<Buddy> getBuddies() const;
+		/** Get buddies of this account.
+		 *
+		 * The set is maintained by the buddy list callbacks, so iterating
+		 * on it neither walks the buddy list nor copies anything.
+		 */
+		const set<Buddy>& getBuddies() const;
 
 		/** All buddiers are updated */
 		void updatedAllBuddies() const;
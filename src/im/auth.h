@@ -46,12 +46,33 @@ namespace im
 		virtual ~Auth() {}
 		virtual bool exists() = 0;
 		virtual bool authenticate(const string& password) = 0;
+
+		/** Does checking the password block for a while?
+		 *
+		 * If so, AuthWorker calls verify() in a helper thread before
+		 * authenticate() is called.
+		 */
+		virtual bool isBlocking() const { return false; }
+
+		/** Check the password, without touching anything but this
+		 * object, as it may be called from a helper thread.
+		 */
+		virtual bool verify(const string& password) { return false; }
+
+		/** The auth cache knows the password is right, so the blocking
+		 * password check of verify() can be skipped, but not the check
+		 * that the account is still usable. Same thread rules as
+		 * verify().
+		 */
+		virtual void trust(const string& password) {}
+
 		virtual im::IM* create(const string& password);
 		im::IM* getIM() { return im; };
 		virtual bool setPassword(const string& password) = 0;
 		virtual string getPassword() const = 0;
 
 	protected:
+		friend class AuthWorker;
 		static vector<Auth*> getMechanisms(irc::IRC* irc, const string& username);
 		string username;
 		irc::IRC* irc;
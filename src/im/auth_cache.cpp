@@ -0,0 +1,172 @@
+/*
+ * Minbif - IRC instant messaging gateway
+ * Copyright(C) 2009-2010 Romain Bignon
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <glib.h>
+
+#include "im/auth_cache.h"
+#include "core/util.h"
+
+namespace im {
+
+string AuthCache::sha256(const string& data)
+{
+	gchar* sum = g_compute_checksum_for_string(G_CHECKSUM_SHA256, data.c_str(), data.size());
+	string s = sum;
+	g_free(sum);
+	return s;
+}
+
+string AuthCache::digest(const string& username, const string& password)
+{
+	return sha256(strlower(username) + ":" + password);
+}
+
+string AuthCache::hash(const Entry& entry, const string& digest) const
+{
+	return sha256(entry.salt + digest);
+}
+
+string AuthCache::resultToString(result_t result)
+{
+	switch(result)
+	{
+		case VALID: return "VALID";
+		case INVALID: return "INVALID";
+		case LOCKED: return "LOCKED";
+		case UNKNOWN:
+		default: return "UNKNOWN";
+	}
+}
+
+AuthCache::result_t AuthCache::resultFromString(const string& s)
+{
+	if(s == "VALID")
+		return VALID;
+	if(s == "INVALID")
+		return INVALID;
+	if(s == "LOCKED")
+		return LOCKED;
+	return UNKNOWN;
+}
+
+AuthCache::Entry& AuthCache::getEntry(const string& username)
+{
+	string name = strlower(username);
+	map<string, Entry>::iterator it = entries.find(name);
+	if(it != entries.end())
+		return it->second;
+
+	Entry& entry = entries[name];
+	entry.salt = t2s(g_random_int()) + t2s(g_random_int()) + t2s(g_random_int());
+	entry.valid_until = entry.invalid_until = 0;
+	entry.failures = 0;
+	entry.locked_until = entry.last_failure = 0;
+	return entry;
+}
+
+void AuthCache::expire()
+{
+	time_t now = time(NULL);
+	for(map<string, Entry>::iterator it = entries.begin(); it != entries.end();)
+	{
+		Entry& entry = it->second;
+		if(entry.failures && entry.last_failure + (time_t)FAILURES_TTL < now)
+			entry.failures = 0;
+
+		if(entry.valid_until < now && entry.invalid_until < now &&
+		   entry.locked_until < now && !entry.failures)
+			entries.erase(it++);
+		else
+			++it;
+	}
+}
+
+AuthCache::result_t AuthCache::check(const string& username, const string& digest, unsigned* delay)
+{
+	expire();
+
+	map<string, Entry>::iterator it = entries.find(strlower(username));
+	if(it == entries.end())
+		return UNKNOWN;
+
+	Entry& entry = it->second;
+	time_t now = time(NULL);
+
+	if(entry.locked_until > now)
+	{
+		if(delay)
+			*delay = (unsigned)(entry.locked_until - now);
+		return LOCKED;
+	}
+
+	string h = hash(entry, digest);
+	if(entry.valid_until >= now && h == entry.valid_hash)
+		return VALID;
+	if(entry.invalid_until >= now && h == entry.invalid_hash)
+		return INVALID;
+
+	return UNKNOWN;
+}
+
+void AuthCache::success(const string& username, const string& digest)
+{
+	expire();
+
+	Entry& entry = getEntry(username);
+	entry.valid_hash = hash(entry, digest);
+	entry.valid_until = time(NULL) + VALID_TTL;
+	entry.invalid_hash.clear();
+	entry.invalid_until = 0;
+	entry.failures = 0;
+	entry.locked_until = 0;
+}
+
+void AuthCache::failure(const string& username, const string& digest)
+{
+	expire();
+
+	Entry& entry = getEntry(username);
+	time_t now = time(NULL);
+	string h = hash(entry, digest);
+
+	if(h == entry.valid_hash)
+	{
+		entry.valid_hash.clear();
+		entry.valid_until = 0;
+	}
+	entry.invalid_hash = h;
+	entry.invalid_until = now + INVALID_TTL;
+	entry.last_failure = now;
+
+	if(++entry.failures >= LOCKOUT_THRESHOLD)
+	{
+		unsigned lockout = LOCKOUT_BASE;
+		for(unsigned n = entry.failures - LOCKOUT_THRESHOLD; n > 0 && lockout < LOCKOUT_MAX; --n)
+			lockout *= 2;
+		if(lockout > LOCKOUT_MAX)
+			lockout = LOCKOUT_MAX;
+		entry.locked_until = now + lockout;
+	}
+}
+
+void AuthCache::forget(const string& username)
+{
+	entries.erase(strlower(username));
+}
+
+}; /* namespace im */
@@ -0,0 +1,110 @@
+/*
+ * Minbif - IRC instant messaging gateway
+ * Copyright(C) 2009-2010 Romain Bignon
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef IM_AUTH_CACHE_H
+#define IM_AUTH_CACHE_H
+
+#include <ctime>
+#include <string>
+#include <map>
+
+namespace im
+{
+	using std::string;
+	using std::map;
+
+	/** Memory-only cache of authentication results.
+	 *
+	 * It lives in the master process of the daemon fork mode, and
+	 * children ask it before checking a password with a blocking
+	 * mechanism (see AuthWorker). Only salted hashes of password
+	 * digests are kept.
+	 *
+	 * Successful results are remembered for a few minutes, failures
+	 * are counted and, after a few of them, the user is locked out for
+	 * a time growing exponentially.
+	 */
+	class AuthCache
+	{
+		struct Entry
+		{
+			string salt;
+			string valid_hash;     /**< empty if no successful result */
+			time_t valid_until;
+			string invalid_hash;   /**< last wrong password */
+			time_t invalid_until;
+			unsigned failures;
+			time_t locked_until;
+			time_t last_failure;
+		};
+
+		map<string, Entry> entries;   /**< lower case username -> entry */
+
+		static const unsigned VALID_TTL = 300;      /**< s */
+		static const unsigned INVALID_TTL = 60;     /**< s */
+		static const unsigned FAILURES_TTL = 3600;  /**< s before failures are forgotten */
+		static const unsigned LOCKOUT_THRESHOLD = 3;
+		static const unsigned LOCKOUT_BASE = 5;     /**< s */
+		static const unsigned LOCKOUT_MAX = 900;    /**< s */
+
+		static string sha256(const string& data);
+		string hash(const Entry& entry, const string& digest) const;
+		Entry& getEntry(const string& username);
+		void expire();
+
+	public:
+
+		enum result_t
+		{
+			UNKNOWN,
+			VALID,
+			INVALID,
+			LOCKED
+		};
+
+		/** Digest of credentials, computed by children, so the
+		 * password itself is never sent to the master.
+		 */
+		static string digest(const string& username, const string& password);
+
+		static string resultToString(result_t result);
+		static result_t resultFromString(const string& s);
+
+		/** Look for a previous result.
+		 *
+		 * @param username  user name
+		 * @param digest  digest of credentials
+		 * @param delay  if LOCKED, set to seconds before the lockout ends
+		 */
+		result_t check(const string& username, const string& digest, unsigned* delay = NULL);
+
+		/** These credentials have been accepted. */
+		void success(const string& username, const string& digest);
+
+		/** These credentials have been rejected. */
+		void failure(const string& username, const string& digest);
+
+		/** Forget everything about this user, for example after a
+		 * password change.
+		 */
+		void forget(const string& username);
+	};
+
+}; /* namespace im */
+
+#endif /* IM_AUTH_CACHE_H */
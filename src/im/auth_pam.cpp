@@ -31,7 +31,9 @@
 namespace im
 {
 AuthPAM::AuthPAM(irc::IRC* _irc, const string& _username)
-	: Auth(_irc, _username)
+	: Auth(_irc, _username),
+	  checked(false),
+	  valid(false)
 {
 	pamh = NULL;
 }
@@ -107,7 +109,7 @@ static int pam_conv_func(int num_msg, const struct pam_message **msgm, struct pa
 	return PAM_CONV_ERR;
 }
 
-bool AuthPAM::checkPassword(const string& password)
+bool AuthPAM::open(const string& password)
 {
 	int retval;
 
@@ -121,23 +123,36 @@ bool AuthPAM::checkPassword(const string& password)
 	pam_conv_func_data.password = password;
 
 	retval = pam_start("minbif", username.c_str(), &pam_conversation, &pamh);
-	if (retval == PAM_SUCCESS)
+	if (retval != PAM_SUCCESS)
+	{
+		close(retval);
+		return false;
+	}
+
+	if (conf.GetSection("aaa")->GetItem("pam_setuid")->Boolean() == true)
 	{
-		if (conf.GetSection("aaa")->GetItem("pam_setuid")->Boolean() == true)
+		struct passwd *pwd;
+		pwd = getpwnam(username.c_str());
+		if (setuid(pwd->pw_uid) != 0)
 		{
-			struct passwd *pwd;
-			pwd = getpwnam(username.c_str());
-			if (setuid(pwd->pw_uid) != 0)
-			{
-				b_log[W_ERR] << "Minbif needs to be launched in root for setuid_pam: ";
-				close();
-				return false;
-			}
+			b_log[W_ERR] << "Minbif needs to be launched in root for setuid_pam: ";
+			close();
+			return false;
 		}
-
-		retval = pam_authenticate(pamh, 0);	/* is user really user? */
 	}
 
+	return true;
+}
+
+bool AuthPAM::checkPassword(const string& password)
+{
+	int retval;
+
+	if (!open(password))
+		return false;
+
+	retval = pam_authenticate(pamh, 0);	/* is user really user? */
+
 	if (retval == PAM_SUCCESS)
 		retval = pam_acct_mgmt(pamh, 0);	/* permitted access? */
 
@@ -152,11 +167,61 @@ bool AuthPAM::checkPassword(const string& password)
 
 }
 
-bool AuthPAM::authenticate(const string& password)
+bool AuthPAM::verify(const string& password)
 {
 	b_log[W_DEBUG] << "Authenticating user " << username << " using PAM mechanism";
 
-	if(checkPassword(password))
+	/* Called from the helper thread, so close() errors must not
+	 * leave this function. */
+	try
+	{
+		valid = checkPassword(password);
+	}
+	catch(IMError& e)
+	{
+		/* Already logged. */
+		valid = false;
+	}
+	checked = true;
+	return valid;
+}
+
+void AuthPAM::trust(const string& password)
+{
+	b_log[W_DEBUG] << "Authenticating user " << username << " using PAM mechanism (cached)";
+
+	checked = true;
+	valid = false;
+
+	/* Called from the helper thread, like verify(). */
+	try
+	{
+		/* The handle is still needed to change password. */
+		if(!open(password))
+			return;
+
+		/* Only the password check is skipped: an expired, locked or
+		 * disabled account is still refused. */
+		int retval = pam_acct_mgmt(pamh, 0);
+		if(retval != PAM_SUCCESS)
+		{
+			close(retval);
+			return;
+		}
+		valid = true;
+	}
+	catch(IMError& e)
+	{
+		/* Already logged, and the account is refused. */
+	}
+}
+
+bool AuthPAM::authenticate(const string& password)
+{
+	if(!checked)
+		verify(password);
+
+	if(valid)
 	{
 		im = new im::IM(irc, username);
 		return true;
@@ -41,6 +41,9 @@ namespace im
 		~AuthPAM();
 		bool exists();
 		bool authenticate(const string& password);
+		bool isBlocking() const { return true; }
+		bool verify(const string& password);
+		void trust(const string& password);
 		im::IM* create(const string& password);
 		bool setPassword(const string& password);
 		string getPassword() const;
@@ -49,8 +52,11 @@ namespace im
 		pam_handle_t *pamh;
 		struct pam_conv pam_conversation;
 		struct _pam_conv_func_data pam_conv_func_data;
+		bool checked;   /**< verify() has already been called */
+		bool valid;
 
 		void close(int retval = PAM_SUCCESS);
+		bool open(const string& password);
 		bool checkPassword(const string& password);
 	};
 };
@@ -0,0 +1,195 @@
+/*
+ * Minbif - IRC instant messaging gateway
+ * Copyright(C) 2009-2010 Romain Bignon
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <cassert>
+
+#include "im/auth_worker.h"
+#include "im/auth.h"
+#include "core/callback.h"
+#include "core/log.h"
+
+namespace im {
+
+AuthWorker::AuthWorker(irc::IRC* irc, const string& username, const string& password, _CallBack* _callback)
+	: job(NULL),
+	  callback(_callback),
+	  timeout_id(-1),
+	  started(false),
+	  finished(false),
+	  timed_out(false)
+{
+	vector<Auth*> mechanisms = Auth::getMechanisms(irc, username);
+	if(mechanisms.empty())
+	{
+		delete callback;
+		throw IMError("Login disabled (please consult your administrator)");
+	}
+
+	job = new Job;
+	job->refs = 1;
+	job->worker = this;
+	job->mechanisms = mechanisms;
+	job->password = password;
+	job->trusted = false;
+
+	timeout_id = g_timeout_add_seconds(TIMEOUT, AuthWorker::timeout, this);
+}
+
+AuthWorker::~AuthWorker()
+{
+	if(timeout_id >= 0)
+		g_source_remove(timeout_id);
+
+	/* If the helper thread is still running, the job is deleted
+	 * when it ends. */
+	job->worker = NULL;
+	release(job);
+
+	delete callback;
+}
+
+void AuthWorker::start(bool trusted)
+{
+	if(started)
+		return;
+	started = true;
+
+	bool blocking = false;
+	for(vector<Auth*>::iterator m = job->mechanisms.begin(); m != job->mechanisms.end() && !blocking; ++m)
+		blocking = (*m)->isBlocking();
+
+	/* Account checks may block too, so trusted passwords are also
+	 * handled by the helper thread. */
+	job->trusted = trusted;
+	job->refs++;
+
+	if(!blocking)
+	{
+		g_idle_add(AuthWorker::done, job);
+		return;
+	}
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+	GThread* thread = g_thread_try_new("minbif-auth", AuthWorker::run, job, NULL);
+	if(thread)
+		g_thread_unref(thread);
+#else
+	GThread* thread = g_thread_create(AuthWorker::run, job, FALSE, NULL);
+#endif
+
+	if(!thread)
+	{
+		b_log[W_WARNING] << "Unable to start the authentication thread, checking password synchronously";
+		run(job);
+	}
+}
+
+void AuthWorker::release(Job* job)
+{
+	if(--job->refs > 0)
+		return;
+
+	for(vector<Auth*>::iterator m = job->mechanisms.begin(); m != job->mechanisms.end(); ++m)
+		delete *m;
+	delete job;
+}
+
+gpointer AuthWorker::run(gpointer data)
+{
+	Job* job = static_cast<Job*>(data);
+
+	for(vector<Auth*>::iterator m = job->mechanisms.begin(); m != job->mechanisms.end(); ++m)
+	{
+		if(!(*m)->isBlocking())
+			continue;
+		/* Exceptions must not leave the helper thread, a mechanism
+		 * which throws has failed. */
+		try
+		{
+			if(job->trusted)
+				(*m)->trust(job->password);
+			else if((*m)->verify(job->password))
+				break;
+		}
+		catch(IMError& e)
+		{
+		}
+	}
+
+	g_idle_add(AuthWorker::done, job);
+	return NULL;
+}
+
+gboolean AuthWorker::done(gpointer data)
+{
+	Job* job = static_cast<Job*>(data);
+	AuthWorker* worker = job->worker;
+
+	release(job);
+
+	if(worker && !worker->timed_out)
+	{
+		if(worker->timeout_id >= 0)
+			g_source_remove(worker->timeout_id);
+		worker->timeout_id = -1;
+		worker->finished = true;
+
+		/* It may delete the worker. */
+		worker->callback->run();
+	}
+
+	return FALSE;
+}
+
+gboolean AuthWorker::timeout(gpointer data)
+{
+	AuthWorker* worker = static_cast<AuthWorker*>(data);
+
+	b_log[W_WARNING] << "Authentication has not finished after " << (unsigned)TIMEOUT << " seconds";
+
+	worker->timeout_id = -1;
+	worker->timed_out = true;
+
+	/* It may delete the worker. */
+	worker->callback->run();
+
+	return FALSE;
+}
+
+Auth* AuthWorker::getAuth()
+{
+	assert(finished);
+
+	/* Taken from the job, so they are not deleted twice if authenticate()
+	 * throws an exception. */
+	vector<Auth*> mechanisms;
+	mechanisms.swap(job->mechanisms);
+
+	Auth* mech_ok = NULL;
+	for(vector<Auth*>::iterator m = mechanisms.begin(); m != mechanisms.end(); ++m)
+	{
+		if((mech_ok == NULL) && (*m)->exists() && (*m)->authenticate(job->password))
+			mech_ok = *m;
+		else
+			delete *m;
+	}
+
+	return mech_ok;
+}
+
+}; /* namespace im */
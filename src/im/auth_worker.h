@@ -0,0 +1,115 @@
+/*
+ * Minbif - IRC instant messaging gateway
+ * Copyright(C) 2009-2010 Romain Bignon
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef IM_AUTH_WORKER_H
+#define IM_AUTH_WORKER_H
+
+#include <glib.h>
+#include <string>
+#include <vector>
+
+class _CallBack;
+
+namespace irc
+{
+	class IRC;
+};
+
+namespace im
+{
+	using std::string;
+	using std::vector;
+
+	class Auth;
+
+	/** Validate credentials without blocking the event loop.
+	 *
+	 * Mechanisms which may block (see Auth::isBlocking()) check the
+	 * password in a helper thread. When they are done, the callback
+	 * is called from the main loop, and getAuth() finishes the
+	 * validation like Auth::validate() does.
+	 *
+	 * There is only one connection per process, so the number of
+	 * concurrent checks is limited by the daemon master, which
+	 * answers the AUTH CHECK request when a slot is free (see
+	 * DaemonForkServerPoll::m_auth()). In inetd mode, there is no
+	 * such limit.
+	 */
+	class AuthWorker
+	{
+		/** Shared between the worker object and the helper thread.
+		 *
+		 * The helper thread only reads mechanisms, password and
+		 * trusted, and the other fields are only used from the main
+		 * loop, so there is no need to lock it.
+		 */
+		struct Job
+		{
+			unsigned refs;
+			AuthWorker* worker;       /**< NULL once the worker is deleted */
+			vector<Auth*> mechanisms;
+			string password;
+			bool trusted;             /**< call Auth::trust() instead of Auth::verify() */
+		};
+
+		Job* job;
+		_CallBack* callback;
+		int timeout_id;
+		bool started;
+		bool finished;
+		bool timed_out;
+
+		static const unsigned TIMEOUT = 30;    /**< s */
+
+		static void release(Job* job);
+		static gpointer run(gpointer data);
+		static gboolean done(gpointer data);
+		static gboolean timeout(gpointer data);
+
+	public:
+
+		/** Prepare validating credentials.
+		 *
+		 * @param irc  the IRC object
+		 * @param username  user name
+		 * @param password  password
+		 * @param callback  called from the main loop when the result is
+		 *                  available. The worker takes ownership of it.
+		 */
+		AuthWorker(irc::IRC* irc, const string& username, const string& password, _CallBack* callback);
+		~AuthWorker();
+
+		/** Start checking password.
+		 *
+		 * @param trusted  the auth cache knows the password is right,
+		 *                 so blocking mechanisms only check that the
+		 *                 account is still usable.
+		 */
+		void start(bool trusted = false);
+
+		/** The helper thread did not answer in time. */
+		bool hasTimedOut() const { return timed_out; }
+
+		/** Get the authenticated mechanism, or NULL if credentials
+		 * are wrong. Call it only once, from the callback.
+		 */
+		Auth* getAuth();
+	};
+};
+
+#endif /* IM_AUTH_WORKER_H */
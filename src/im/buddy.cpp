@@ -17,6 +17,8 @@
  */
 
 #include <cassert>
+#include <set>
+#include <map>
 
 #include "im/purple.h"
 #include "im/buddy.h"
@@ -31,6 +33,18 @@
 
 namespace im {
 
+/* Buddies updated by libpurple since the last flush. A same buddy is
+ * often updated several times in a row (for example with several XMPP
+ * presences), so they are processed only once, a bit later. */
+static std::set<Buddy> dirty_buddies;
+static guint dirty_id = 0;
+
+/* Buddies of each account, maintained by the blist UI ops, so an account
+ * does not have to walk the whole buddy list to find its own buddies. */
+static std::map<PurpleAccount*, std::set<Buddy> > account_buddies;
+
+std::map<PurpleBuddy*, Buddy::Snapshot> Buddy::snapshots;
+
 Buddy::Buddy()
 	: buddy(NULL)
 {}
@@ -50,6 +64,11 @@ bool Buddy::operator!=(const Buddy& buddy) const
 	return !isValid() || !buddy.isValid() || buddy.buddy != this->buddy;
 }
 
+bool Buddy::operator<(const Buddy& buddy) const
+{
+	return this->buddy < buddy.buddy;
+}
+
 string Buddy::getName() const
 {
 	assert(isValid());
@@ -60,7 +79,7 @@ string Buddy::getName() const
 		return "";
 }
 
-string Buddy::getAlias() const
+string Buddy::computeAlias() const
 {
 	assert(isValid());
 	const char* a = purple_buddy_get_alias(buddy);
@@ -70,6 +89,46 @@ string Buddy::getAlias() const
 		return getName();
 }
 
+string Buddy::getAlias() const
+{
+	return getSnapshot().alias;
+}
+
+string Buddy::getRealName() const
+{
+	return getSnapshot().realname;
+}
+
+string Buddy::getGroupName() const
+{
+	return getSnapshot().group;
+}
+
+string Buddy::getStatus() const
+{
+	return getSnapshot().status;
+}
+
+const Buddy::Snapshot& Buddy::getSnapshot() const
+{
+	assert(isValid());
+	std::map<PurpleBuddy*, Snapshot>::iterator it = snapshots.find(buddy);
+	if(it != snapshots.end())
+		return it->second;
+
+	Snapshot& snapshot = snapshots[buddy];
+	snapshot.alias = computeAlias();
+	snapshot.realname = computeRealName();
+	snapshot.group = computeGroupName();
+	snapshot.status = computeStatus();
+	return snapshot;
+}
+
+void Buddy::invalidateSnapshot() const
+{
+	snapshots.erase(buddy);
+}
+
 void Buddy::setAlias(string alias, bool server_side) const
 {
 	assert(isValid());
@@ -108,7 +167,7 @@ void Buddy::setNick(irc::Buddy* b)
 	node->ui_data = b;
 }
 
-string Buddy::getGroupName() const
+string Buddy::computeGroupName() const
 {
 	assert(isValid());
 	PurpleGroup* group = purple_buddy_get_group(buddy);
@@ -132,15 +191,35 @@ void Buddy::sendFile(string filename)
 
 void Buddy::updated() const
 {
-	irc::StatusChannel* chan = getAccount().getStatusChannel();
-	if(!chan)
-		return;
-
 	irc::Buddy* n = getNick();
 	if(!n)
 		n = dynamic_cast<irc::Buddy*>(Purple::getIM()->getIRC()->getNick(*this));
 	if(!n)
 		return;
+
+	irc::Buddy::State state;
+	state.online = isOnline();
+	state.voice = state.online && isAvailable() && Purple::getIM()->hasVoicedBuddies();
+	state.away = n->isAway();
+	state.nickname = n->getNickname();
+	state.realname = n->getRealName();
+	state.status = n->getStatusMessage(true);
+	if(n->setState(state))
+	{
+		n->invalidateWhoCache();
+		Purple::getIM()->getIRC()->updateMonitor(n->getNickname());
+	}
+
+	irc::StatusChannel* chan = getAccount().getStatusChannel();
+	if(!chan)
+		return;
+
+	if(chan->inBurst())
+	{
+		chan->addBurstBuddy(*this);
+		return;
+	}
+
 	if(isOnline())
 	{
 		bool available = isAvailable() && Purple::getIM()->hasVoicedBuddies();
@@ -161,7 +240,7 @@ void Buddy::updated() const
 		n->quit("Signed-Off");
 }
 
-string Buddy::getRealName() const
+string Buddy::computeRealName() const
 {
 	assert(isValid());
 	const char* rn = purple_buddy_get_server_alias(buddy);
@@ -189,8 +268,9 @@ bool Buddy::isAvailable() const
 	return purple_presence_is_available(purple_buddy_get_presence(buddy));
 }
 
-string Buddy::getStatus() const
+string Buddy::computeStatus() const
 {
+	assert(isValid());
 	PurpleStatus* status = purple_presence_get_active_status(buddy->presence);
 	if(!status)
 		return "";
@@ -287,11 +367,31 @@ void Buddy::init()
 	purple_blist_set_ui_ops(&blist_ui_ops);
 	purple_signal_connect(purple_blist_get_handle(), "buddy-signed-on", getHandler(), PURPLE_CALLBACK(buddy_signonoff_cb), NULL);
 	purple_signal_connect(purple_blist_get_handle(), "buddy-signed-off", getHandler(), PURPLE_CALLBACK(buddy_signonoff_cb), NULL);
+	purple_signal_connect(purple_blist_get_handle(), "buddy-status-changed", getHandler(), PURPLE_CALLBACK(buddy_changed_cb), NULL);
+	purple_signal_connect(purple_blist_get_handle(), "blist-node-aliased", getHandler(), PURPLE_CALLBACK(node_aliased_cb), NULL);
 }
 
 void Buddy::uninit()
 {
 	purple_blist_set_ui_ops(NULL);
+	if(dirty_id)
+		g_source_remove(dirty_id);
+	dirty_id = 0;
+	dirty_buddies.clear();
+	account_buddies.clear();
+	snapshots.clear();
+	purple_signals_disconnect_by_handle(getHandler());
+}
+
+const std::set<Buddy>& Buddy::getAccountBuddies(PurpleAccount* account)
+{
+	static const std::set<Buddy> no_buddies;
+
+	std::map<PurpleAccount*, std::set<Buddy> >::const_iterator it = account_buddies.find(account);
+	if(it == account_buddies.end())
+		return no_buddies;
+	else
+		return it->second;
 }
 
 void* Buddy::getHandler()
@@ -306,11 +406,43 @@ void Buddy::buddy_signonoff_cb(PurpleBuddy* buddy)
 	update_node(NULL, (PurpleBlistNode*)buddy);
 }
 
+void Buddy::buddy_changed_cb(PurpleBuddy* buddy)
+{
+	Buddy(buddy).invalidateSnapshot();
+}
+
+void Buddy::node_aliased_cb(PurpleBlistNode* node, const char* old_alias)
+{
+	if(PURPLE_BLIST_NODE_IS_BUDDY(node))
+		Buddy((PurpleBuddy*)node).invalidateSnapshot();
+}
+
+void Buddy::setDirty() const
+{
+	dirty_buddies.insert(*this);
+	if(!dirty_id)
+		dirty_id = g_timeout_add(UPDATE_DELAY, Buddy::flush_dirty, NULL);
+}
+
+gboolean Buddy::flush_dirty(void*)
+{
+	std::set<Buddy> buddies;
+	buddies.swap(dirty_buddies);
+	dirty_id = 0;
+
+	for(std::set<Buddy>::iterator it = buddies.begin(); it != buddies.end(); ++it)
+		it->updated();
+	return FALSE;
+}
+
 void Buddy::update_node(PurpleBuddyList *list, PurpleBlistNode *node)
 {
 	if (PURPLE_BLIST_NODE_IS_BUDDY(node))
 	{
 		Buddy buddy = Buddy((PurpleBuddy*)node);
+		buddy.invalidateSnapshot();
+		account_buddies[((PurpleBuddy*)node)->account].insert(buddy);
+
 		irc::Buddy* n = buddy.getNick();
 		if(!n)
 		{
@@ -333,7 +465,7 @@ void Buddy::update_node(PurpleBuddyList *list, PurpleBlistNode *node)
 		if(buddy.getAlias() != n->getNickname())
 			buddy.setAlias(n->getNickname(), false);
 
-		buddy.updated();
+		buddy.setDirty();
 	}
 }
 
@@ -347,6 +479,20 @@ void Buddy::removed_node(PurpleBuddyList *list, PurpleBlistNode *node)
 	if (PURPLE_BLIST_NODE_IS_BUDDY(node))
 	{
 		Buddy buddy = Buddy((PurpleBuddy*)node);
+		dirty_buddies.erase(buddy);
+
+		std::map<PurpleAccount*, std::set<Buddy> >::iterator acc = account_buddies.find(((PurpleBuddy*)node)->account);
+		if(acc != account_buddies.end())
+		{
+			acc->second.erase(buddy);
+			if(acc->second.empty())
+				account_buddies.erase(acc);
+		}
+
+		irc::StatusChannel* chan = buddy.getAccount().getStatusChannel();
+		if(chan)
+			chan->removeBurstBuddy(buddy);
+
 		irc::Buddy* n = buddy.getNick();
 		if(!n)
 			n = dynamic_cast<irc::Buddy*>(Purple::getIM()->getIRC()->getNick(buddy));
@@ -355,6 +501,7 @@ void Buddy::removed_node(PurpleBuddyList *list, PurpleBlistNode *node)
 			n->quit("Removed");
 			Purple::getIM()->getIRC()->removeNick(n->getNickname());
 		}
+		buddy.invalidateSnapshot();
 	}
 }
 
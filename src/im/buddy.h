@@ -21,6 +21,8 @@
 
 #include <purple.h>
 #include <string>
+#include <set>
+#include <map>
 
 #include "core/caca_image.h"
 
@@ -50,12 +52,41 @@ namespace im
 		static void update_node(PurpleBuddyList *list, PurpleBlistNode *node);
 		static void removed_node(PurpleBuddyList *list, PurpleBlistNode *node);
 
+		static const unsigned UPDATE_DELAY = 100; /**< ms to wait before processing updates */
+		static gboolean flush_dirty(void*);
+
+		/** Process updated() later, once even if called several times. */
+		void setDirty() const;
+
+		/** Attributes read by the IRC side, computed once from libpurple
+		 * and refreshed when libpurple notifies a change. */
+		struct Snapshot
+		{
+			string alias;
+			string realname;
+			string group;
+			string status;
+		};
+		static std::map<PurpleBuddy*, Snapshot> snapshots;
+		static void buddy_changed_cb(PurpleBuddy* buddy);
+		static void node_aliased_cb(PurpleBlistNode* node, const char* old_alias);
+
+		const Snapshot& getSnapshot() const;
+		void invalidateSnapshot() const;
+		string computeAlias() const;
+		string computeRealName() const;
+		string computeGroupName() const;
+		string computeStatus() const;
+
 	public:
 
 		/** Initialization of libpurple buddies' stuffs. */
 		static void init();
 		static void uninit();
 
+		/** Get buddies of an account, without walking the buddy list. */
+		static const std::set<Buddy>& getAccountBuddies(PurpleAccount* account);
+
 		/** Empty constructor */
 		Buddy();
 
@@ -68,6 +99,7 @@ namespace im
 		/** Comparaisons */
 		bool operator==(const Buddy& buddy) const;
 		bool operator!=(const Buddy& buddy) const;
+		bool operator<(const Buddy& buddy) const;
 
 		bool isValid() const { return buddy != NULL; }
 
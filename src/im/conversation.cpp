@@ -18,8 +18,10 @@
 
 #include <cassert>
 #include <cstring>
+#include <vector>
 
 #include "im/conversation.h"
+#include "im/send_scheduler.h"
 #include "im/purple.h"
 #include "im/buddy.h"
 #include "im/im.h"
@@ -577,6 +579,7 @@ void Conversation::create(PurpleConversation* c)
 void Conversation::destroy(PurpleConversation* c)
 {
 	Conversation conv(c);
+	SendScheduler::forget(conv);
 
 	switch(conv.getType())
 	{
@@ -674,17 +677,26 @@ void Conversation::add_users(PurpleConversation *c, GList *cbuddies,
 			     gboolean new_arrivals)
 {
 	Conversation conv(c);
-	GList* l = cbuddies;
-	for (; l != NULL; l = l->next)
+	irc::ConversationChannel* chan = conv.getChannel();
+	if(!chan)
 	{
-		ChatBuddy cbuddy = ChatBuddy(conv, (PurpleConvChatBuddy *)l->data);
+		b_log[W_ERR] << "Conversation channel doesn't exist: " << conv.getChanName();
+		return;
+	}
 
-		irc::ConversationChannel* chan = conv.getChannel();
-		if(!chan)
-		{
-			b_log[W_ERR] << "Conversation channel doesn't exist: " << conv.getChanName();
-			return;
-		}
+	/* Users already on channel when we join it are sent together. */
+	if(!new_arrivals && cbuddies && cbuddies->next)
+	{
+		std::vector<ChatBuddy> list;
+		for (GList* l = cbuddies; l != NULL; l = l->next)
+			list.push_back(ChatBuddy(conv, (PurpleConvChatBuddy *)l->data));
+		chan->addBuddies(list);
+		return;
+	}
+
+	for (GList* l = cbuddies; l != NULL; l = l->next)
+	{
+		ChatBuddy cbuddy = ChatBuddy(conv, (PurpleConvChatBuddy *)l->data);
 		chan->addBuddy(cbuddy, cbuddy.getChanStatus());
 	}
 }
@@ -17,6 +17,10 @@
  */
 
 #include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "im/purple.h"
 #include "im/im.h"
@@ -30,6 +34,75 @@
 
 namespace im {
 
+XferPipe::XferPipe(PurpleXfer* _xfer)
+	: xfer(_xfer),
+	  offset(0),
+	  blocked(false),
+	  ready_id(0)
+{}
+
+XferPipe::~XferPipe()
+{
+	detach();
+}
+
+bool XferPipe::write(const guchar* data, size_t len)
+{
+	/* Drop sent data instead of growing forever. */
+	if(offset > 0 && offset >= buffer.size() / 2)
+	{
+		buffer.erase(0, offset);
+		offset = 0;
+	}
+
+	buffer.append((const char*)data, len);
+
+	blocked = size() >= HIGH_WATER;
+	return !blocked;
+}
+
+void XferPipe::consume(size_t len)
+{
+	assert(len <= size());
+
+	offset += len;
+	if(offset == buffer.size())
+	{
+		buffer.clear();
+		offset = 0;
+	}
+
+	/* Not called directly, as it makes libpurple write in the pipe. */
+	if(blocked && xfer && !ready_id && size() < LOW_WATER)
+		ready_id = g_idle_add(XferPipe::ready_cb, this);
+}
+
+gboolean XferPipe::ready_cb(gpointer data)
+{
+	XferPipe* pipe = static_cast<XferPipe*>(data);
+
+	pipe->ready_id = 0;
+	pipe->blocked = false;
+#if PURPLE_VERSION_CHECK(2, 6, 0)
+	if(pipe->xfer)
+		purple_xfer_ui_ready(pipe->xfer);
+#endif
+
+	return FALSE;
+}
+
+void XferPipe::detach()
+{
+	if(ready_id)
+		g_source_remove(ready_id);
+	ready_id = 0;
+	xfer = NULL;
+}
+
+bool FileTransfert::streaming = false;
+map<PurpleXfer*, XferPipe*> FileTransfert::pipes;
+map<PurpleXfer*, FileTransfert::LocalFile> FileTransfert::local_files;
+
 FileTransfert::FileTransfert()
 	: xfer(NULL)
 {}
@@ -97,6 +170,49 @@ Buddy FileTransfert::getBuddy() const
 	return Buddy(purple_find_buddy(xfer->account, xfer->who));
 }
 
+XferPipe* FileTransfert::openPipe()
+{
+	assert(isValid());
+	assert(isStreaming());
+
+	XferPipe* pipe = new XferPipe(xfer);
+	pipes[xfer] = pipe;
+	return pipe;
+}
+
+void FileTransfert::closePipe()
+{
+	assert(isValid());
+
+	map<PurpleXfer*, XferPipe*>::iterator it = pipes.find(xfer);
+	if(it == pipes.end())
+		return;
+
+	it->second->detach();
+	pipes.erase(it);
+
+	/* Called from the DCC, which might be removed if the xfer was
+	 * destroyed now. */
+	if(!isCompleted())
+	{
+		purple_xfer_ref(xfer);
+		g_idle_add(FileTransfert::cancel_cb, xfer);
+	}
+}
+
+gboolean FileTransfert::cancel_cb(gpointer data)
+{
+	PurpleXfer* xfer = static_cast<PurpleXfer*>(data);
+
+	if(!purple_xfer_is_completed(xfer) && !purple_xfer_is_canceled(xfer))
+	{
+		b_log[W_SNO|W_ERR] << "DCC connection closed, aborting receiving file " << purple_xfer_get_filename(xfer);
+		purple_xfer_cancel_local(xfer);
+	}
+	purple_xfer_unref(xfer);
+	return FALSE;
+}
+
 /* STATIC */
 
 void FileTransfert::new_xfer(PurpleXfer* xfer)
@@ -106,6 +222,15 @@ void FileTransfert::new_xfer(PurpleXfer* xfer)
 void FileTransfert::destroy(PurpleXfer* xfer)
 {
 	FileTransfert ft(xfer);
+
+	map<PurpleXfer*, XferPipe*>::iterator it = pipes.find(xfer);
+	if(it != pipes.end())
+	{
+		it->second->detach();
+		pipes.erase(it);
+	}
+	closeLocalFile(xfer);
+
 	Purple::getIM()->getIRC()->updateDCC(ft, true);
 
 	if(ft.isCompleted())
@@ -151,6 +276,13 @@ void FileTransfert::add_xfer(PurpleXfer* xfer)
 	{
 		b_log[W_INFO|W_SNO] << "Starting sending file " << ft.getFileName() << " to " << ft.getRemoteUser();
 	}
+
+	/* With UI read and write operations, libpurple waits for the UI
+	 * to be ready before each chunk. */
+#if PURPLE_VERSION_CHECK(2, 6, 0)
+	if(isStreaming())
+		purple_xfer_ui_ready(xfer);
+#endif
 }
 
 void FileTransfert::update_progress(PurpleXfer* xfer, double percent)
@@ -178,6 +310,105 @@ void FileTransfert::cancel_remote(PurpleXfer* xfer)
 		b_log[W_SNO|W_ERR] << ft.getRemoteUser() << " aborted sending file " << ft.getFileName();
 }
 
+void FileTransfert::closeLocalFile(PurpleXfer* xfer)
+{
+	map<PurpleXfer*, LocalFile>::iterator it = local_files.find(xfer);
+	if(it == local_files.end())
+		return;
+
+	close(it->second.fd);
+	local_files.erase(it);
+}
+
+#if PURPLE_VERSION_CHECK(2, 6, 0)
+FileTransfert::LocalFile* FileTransfert::getLocalFile(PurpleXfer* xfer)
+{
+	map<PurpleXfer*, LocalFile>::iterator it = local_files.find(xfer);
+	if(it != local_files.end())
+		return &it->second;
+
+	/* Files which are not streamed are read and written like libpurple
+	 * does when there isn't any UI operations. */
+	LocalFile file;
+	file.offset = purple_xfer_get_bytes_sent(xfer);
+	if(purple_xfer_get_type(xfer) == PURPLE_XFER_RECEIVE)
+		file.fd = open(purple_xfer_get_local_filename(xfer), O_WRONLY|O_CREAT|(file.offset ? 0 : O_TRUNC), 0666);
+	else
+		file.fd = open(purple_xfer_get_local_filename(xfer), O_RDONLY);
+
+	if(file.fd < 0)
+	{
+		b_log[W_SNO|W_ERR] << "Unable to open " << purple_xfer_get_local_filename(xfer) << ": " << strerror(errno);
+		return NULL;
+	}
+	fcntl(file.fd, F_SETFD, FD_CLOEXEC);
+
+	return &(local_files[xfer] = file);
+}
+
+gssize FileTransfert::ui_write(PurpleXfer* xfer, const guchar* buffer, gssize size)
+{
+	map<PurpleXfer*, XferPipe*>::iterator it = pipes.find(xfer);
+	if(it != pipes.end())
+	{
+		bool room = it->second->write(buffer, size);
+		Purple::getIM()->getIRC()->updateDCC(FileTransfert(xfer));
+
+		/* Otherwise, the pipe tells libpurple when it has been
+		 * consumed by the DCC. */
+		if(room)
+			purple_xfer_ui_ready(xfer);
+		return size;
+	}
+
+	LocalFile* file = getLocalFile(xfer);
+	if(!file)
+		return -1;
+
+	gssize len = pwrite(file->fd, buffer, size, file->offset);
+	if(len < 0)
+	{
+		b_log[W_SNO|W_ERR] << "Unable to write received data: " << strerror(errno);
+		return -1;
+	}
+
+	file->offset += len;
+	purple_xfer_ui_ready(xfer);
+	return len;
+}
+
+gssize FileTransfert::ui_read(PurpleXfer* xfer, guchar** buffer, gssize size)
+{
+	LocalFile* file = getLocalFile(xfer);
+	if(!file)
+		return -1;
+
+	*buffer = (guchar*)g_malloc(size);
+	gssize len = pread(file->fd, *buffer, size, file->offset);
+	if(len <= 0)
+	{
+		/* libpurple waits for more data, but the file is complete. */
+		b_log[W_SNO|W_ERR] << "Unable to read " << purple_xfer_get_local_filename(xfer)
+		                   << ": " << (len < 0 ? strerror(errno) : "file is too short");
+		g_free(*buffer);
+		*buffer = NULL;
+		return -1;
+	}
+
+	file->offset += len;
+	purple_xfer_ui_ready(xfer);
+	return len;
+}
+
+void FileTransfert::data_not_sent(PurpleXfer* xfer, const guchar* buffer, gsize size)
+{
+	/* Send it again in the next chunk. */
+	LocalFile* file = getLocalFile(xfer);
+	if(file)
+		file->offset -= size;
+}
+#endif /* PURPLE_VERSION_CHECK(2, 6, 0) */
+
 PurpleXferUiOps FileTransfert::ui_ops =
 {
 	new_xfer,
@@ -186,16 +417,40 @@ PurpleXferUiOps FileTransfert::ui_ops =
 	update_progress,
 	cancel_local,
 	cancel_remote,
-
-	/* padding */
+#if PURPLE_VERSION_CHECK(2, 6, 0)
+	ui_write,
+	ui_read,
+	data_not_sent,
+#else
 	NULL,
 	NULL,
 	NULL,
+#endif
+
+	/* padding */
 	NULL
 };
 
 void FileTransfert::init()
 {
+	ConfigSection* section = conf.GetSection("file_transfers");
+
+#if PURPLE_VERSION_CHECK(2, 6, 0)
+	streaming = section->GetItem("dcc")->Boolean() && section->GetItem("dcc_stream")->Boolean();
+
+	/* Without streaming, libpurple reads and writes files itself. */
+	if(!streaming)
+	{
+		ui_ops.ui_write = NULL;
+		ui_ops.ui_read = NULL;
+		ui_ops.data_not_sent = NULL;
+	}
+#else
+	if(section->GetItem("dcc_stream")->Boolean())
+		b_log[W_WARNING] << "Streaming file transfers requires libpurple 2.6.0 or newer";
+	streaming = false;
+#endif
+
 	purple_xfers_set_ui_ops(&ui_ops);
 }
 
@@ -20,11 +20,58 @@
 #define IM_FT_H
 
 #include <purple.h>
+#include <sys/types.h>
 #include <string>
+#include <map>
 
 namespace im {
 
 	using std::string;
+	using std::map;
+
+	/** Bounded in-memory buffer between a receiving xfer and a DCC.
+	 *
+	 * libpurple writes received data into it (see
+	 * FileTransfert::ui_write()) instead of writting it in the local
+	 * file, and the DCC reads it. When it is full, libpurple is not
+	 * told to read more data until the DCC has consumed enough.
+	 */
+	class XferPipe
+	{
+		PurpleXfer* xfer;
+		string buffer;
+		size_t offset;
+		bool blocked;        /**< libpurple waits for room */
+		guint ready_id;
+
+		static const size_t HIGH_WATER = 512 * 1024;
+		static const size_t LOW_WATER = 128 * 1024;
+
+		static gboolean ready_cb(gpointer data);
+
+	public:
+
+		XferPipe(PurpleXfer* xfer);
+		~XferPipe();
+
+		/** Append received data.
+		 *
+		 * @return  false if the pipe is full, so libpurple has to
+		 *          wait before reading more.
+		 */
+		bool write(const guchar* data, size_t len);
+
+		const char* data() const { return buffer.data() + offset; }
+		size_t size() const { return buffer.size() - offset; }
+
+		/** Remove sent data, and let libpurple read more if there is
+		 * room enough. */
+		void consume(size_t len);
+
+		/** The xfer is destroyed, nothing will be written anymore. */
+		void detach();
+		bool isDetached() const { return xfer == NULL; }
+	};
 
 	class Buddy;
 	class FileTransfert
@@ -32,6 +79,15 @@ namespace im {
 		PurpleXfer* xfer;
 
 		static PurpleXferUiOps ui_ops;
+		struct LocalFile
+		{
+			int fd;
+			off_t offset;
+		};
+
+		static bool streaming;
+		static map<PurpleXfer*, XferPipe*> pipes;
+		static map<PurpleXfer*, LocalFile> local_files;
 
 		static void new_xfer(PurpleXfer* xfer);
 		static void destroy(PurpleXfer* xfer);
@@ -39,11 +95,21 @@ namespace im {
 		static void update_progress(PurpleXfer* xfer, double percent);
 		static void cancel_local(PurpleXfer* xfer);
 		static void cancel_remote(PurpleXfer* xfer);
+		static gssize ui_write(PurpleXfer* xfer, const guchar* buffer, gssize size);
+		static gssize ui_read(PurpleXfer* xfer, guchar** buffer, gssize size);
+		static void data_not_sent(PurpleXfer* xfer, const guchar* buffer, gsize size);
+		static LocalFile* getLocalFile(PurpleXfer* xfer);
+		static void closeLocalFile(PurpleXfer* xfer);
+		static gboolean cancel_cb(gpointer data);
 	public:
 
 		static void init();
 		static void uninit();
 
+		/** Received files are streamed to DCC without being written
+		 * on disk. */
+		static bool isStreaming() { return streaming; }
+
 		FileTransfert();
 		FileTransfert(PurpleXfer* xfer);
 		~FileTransfert() {}
@@ -51,6 +117,7 @@ namespace im {
 		bool operator==(const FileTransfert& ft);
 
 		bool isValid() const { return xfer != NULL; }
+		PurpleXfer* getPurpleXfer() const { return xfer; }
 
 		string getRemoteUser() const;
 		Buddy getBuddy() const;
@@ -61,6 +128,14 @@ namespace im {
 		bool isCompleted() const;
 		bool isReceiving() const;
 		bool isSending() const;
+
+		/** Stream received data into a new pipe. The caller takes
+		 * the ownership of it. */
+		XferPipe* openPipe();
+
+		/** Stop streaming to the pipe, and cancel the transfer if
+		 * it is not completed, as data would be lost. */
+		void closePipe();
 	};
 
 };
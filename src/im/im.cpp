@@ -23,10 +23,12 @@
 
 #include "im.h"
 #include "purple.h"
+#include "login_scheduler.h"
 #include "irc/irc.h"
 #include "irc/user.h"
 #include "core/log.h"
 #include "core/util.h"
+#include "core/caca_image.h"
 
 namespace im
 {
@@ -75,6 +77,8 @@ IM::IM(irc::IRC* _irc, string _username)
 	else
 		closedir(d);
 
+	CacaImage::setCacheDir(user_path + "/icons_cache");
+
 	try
 	{
 		Purple::init(this);
@@ -92,9 +96,13 @@ IM::~IM()
 
 void IM::restore()
 {
+	/* libpurple would connect every enabled account at once while
+	 * restoring statuses, so let the login scheduler connect them. */
+	LoginScheduler::hold();
 	if (!purple_prefs_get_bool("/purple/savedstatus/startup_current_status"))
 		purple_savedstatus_activate(purple_savedstatus_get_startup());
 	purple_accounts_restore_current_statuses();
+	LoginScheduler::release();
 }
 
 void IM::setPassword(const string& password)
@@ -187,8 +195,8 @@ map<string, Plugin> IM::getPluginsList() const
 
 Protocol IM::getProtocol(string id) const
 {
-	map<string, Protocol> plist = getProtocolsList();
-	map<string, Protocol>::iterator it = plist.find(id);
+	const map<string, Protocol>& plist = Purple::getProtocolsList();
+	map<string, Protocol>::const_iterator it = plist.find(id);
 	if(it == plist.end())
 		throw ProtocolUnknown();
 	else
@@ -202,20 +210,12 @@ map<string, Account> IM::getAccountsList() const
 
 Account IM::getAccount(string name) const
 {
-	map<string, Account> alist = getAccountsList();
-	for(map<string, Account>::iterator it = alist.begin(); it != alist.end(); ++it)
-		if(it->second.getServername() == name || it->second.getID() == name)
-			return it->second;
-	return Account();
+	return Purple::getAccount(name);
 }
 
 Account IM::getAccountFromChannel(string name) const
 {
-	map<string, Account> alist = getAccountsList();
-	for(map<string, Account>::iterator it = alist.begin(); it != alist.end(); ++it)
-		if(it->second.getStatusChannelName() == name)
-			return it->second;
-	return Account();
+	return Purple::getAccountFromChannel(name);
 }
 
 
@@ -0,0 +1,261 @@
+/*
+ * Minbif - IRC instant messaging gateway
+ * Copyright(C) 2009-2010 Romain Bignon
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <cassert>
+#include <ctime>
+
+#include "im/login_scheduler.h"
+#include "im/account.h"
+#include "im/purple.h"
+#include "core/version.h"
+#include "core/log.h"
+
+namespace im {
+
+vector<LoginScheduler::Entry> LoginScheduler::queue;
+map<PurpleAccount*, GTimeVal> LoginScheduler::connecting;
+map<PurpleAccount*, unsigned> LoginScheduler::failures;
+guint LoginScheduler::timer_id = 0;
+unsigned long LoginScheduler::connects = 0;
+unsigned long LoginScheduler::total_latency = 0;
+unsigned long LoginScheduler::last_latency = 0;
+
+void LoginScheduler::init()
+{
+}
+
+void LoginScheduler::uninit()
+{
+	if(timer_id)
+		g_source_remove(timer_id);
+	timer_id = 0;
+	queue.clear();
+	connecting.clear();
+	failures.clear();
+}
+
+bool LoginScheduler::isHealthy(PurpleAccount* account)
+{
+	return purple_account_get_ui_bool(account, MINBIF_VERSION_NAME, "login-healthy", false);
+}
+
+void LoginScheduler::setHealthy(PurpleAccount* account, bool healthy)
+{
+	purple_account_set_ui_bool(account, MINBIF_VERSION_NAME, "login-healthy", healthy);
+}
+
+void LoginScheduler::hold()
+{
+	map<string, Account> accounts = Purple::getAccountsList();
+	for(map<string, Account>::iterator it = accounts.begin(); it != accounts.end(); ++it)
+	{
+		PurpleAccount* account = it->second.getPurpleAccount();
+		if(!purple_account_get_enabled(account, MINBIF_VERSION_NAME))
+			continue;
+
+		/* Remembered in the account settings, so it will still be
+		 * connected at next start if minbif stops before. */
+		purple_account_set_ui_bool(account, MINBIF_VERSION_NAME, "login-queued", true);
+		purple_account_set_enabled(account, MINBIF_VERSION_NAME, false);
+	}
+}
+
+void LoginScheduler::release()
+{
+	map<string, Account> accounts = Purple::getAccountsList();
+	for(map<string, Account>::iterator it = accounts.begin(); it != accounts.end(); ++it)
+		if(purple_account_get_ui_bool(it->second.getPurpleAccount(), MINBIF_VERSION_NAME, "login-queued", false))
+			enqueue(it->second);
+}
+
+void LoginScheduler::enqueue(const Account& account, unsigned delay)
+{
+	assert(account.isValid());
+	PurpleAccount* acc = account.getPurpleAccount();
+
+	if(connecting.find(acc) != connecting.end())
+		return;
+
+	purple_account_set_ui_bool(acc, MINBIF_VERSION_NAME, "login-queued", true);
+
+	time_t ready = time(NULL) + delay;
+	vector<Entry>::iterator it;
+	for(it = queue.begin(); it != queue.end() && it->account != acc; ++it)
+		;
+
+	if(it != queue.end())
+	{
+		if(ready < it->ready)
+			it->ready = ready;
+	}
+	else
+	{
+		Entry entry;
+		entry.account = acc;
+		entry.ready = ready;
+		queue.push_back(entry);
+	}
+
+	dispatch();
+}
+
+unsigned LoginScheduler::retry(const Account& account)
+{
+	assert(account.isValid());
+	PurpleAccount* acc = account.getPurpleAccount();
+
+	connecting.erase(acc);
+	setHealthy(acc, false);
+
+	unsigned n = ++failures[acc];
+	unsigned delay = BACKOFF_BASE;
+	while(n-- > 0 && delay < BACKOFF_MAX)
+		delay *= 2;
+	if(delay > BACKOFF_MAX)
+		delay = BACKOFF_MAX;
+
+	/* Jitter, to not reconnect every account at the same time. */
+	delay = g_random_int_range(delay / 2, delay + 1);
+
+	enqueue(account, delay);
+	return delay;
+}
+
+bool LoginScheduler::cancel(const Account& account)
+{
+	assert(account.isValid());
+	PurpleAccount* acc = account.getPurpleAccount();
+	bool queued = false;
+
+	for(vector<Entry>::iterator it = queue.begin(); it != queue.end(); ++it)
+		if(it->account == acc)
+		{
+			queue.erase(it);
+			queued = true;
+			break;
+		}
+
+	connecting.erase(acc);
+	failures.erase(acc);
+	purple_account_set_ui_bool(acc, MINBIF_VERSION_NAME, "login-queued", false);
+
+	return queued;
+}
+
+void LoginScheduler::connected(const Account& account)
+{
+	assert(account.isValid());
+	PurpleAccount* acc = account.getPurpleAccount();
+
+	map<PurpleAccount*, GTimeVal>::iterator it = connecting.find(acc);
+	if(it != connecting.end())
+	{
+		GTimeVal now;
+		g_get_current_time(&now);
+		last_latency = (now.tv_sec - it->second.tv_sec) * 1000 + (now.tv_usec - it->second.tv_usec) / 1000;
+		total_latency += last_latency;
+		connects++;
+		connecting.erase(it);
+	}
+
+	failures.erase(acc);
+	setHealthy(acc, true);
+	dispatch();
+}
+
+void LoginScheduler::disconnected(const Account& account)
+{
+	assert(account.isValid());
+	if(connecting.erase(account.getPurpleAccount()))
+		dispatch();
+}
+
+void LoginScheduler::dispatch()
+{
+	time_t now = time(NULL);
+
+	while(connecting.size() < MAX_CONNECTING)
+	{
+		/* Take the first ready account, healthy ones first. */
+		vector<Entry>::iterator best = queue.end();
+		for(vector<Entry>::iterator it = queue.begin(); it != queue.end(); ++it)
+		{
+			if(it->ready > now)
+				continue;
+			if(best == queue.end())
+				best = it;
+			if(isHealthy(it->account))
+			{
+				best = it;
+				break;
+			}
+		}
+
+		if(best == queue.end())
+			break;
+
+		PurpleAccount* acc = best->account;
+		queue.erase(best);
+
+		purple_account_set_ui_bool(acc, MINBIF_VERSION_NAME, "login-queued", false);
+		if(!purple_account_is_disconnected(acc))
+			continue;
+
+		/* libpurple does not connect an account with an offline status. */
+		if(purple_presence_is_online(purple_account_get_presence(acc)))
+		{
+			GTimeVal start;
+			g_get_current_time(&start);
+			connecting[acc] = start;
+		}
+
+		purple_account_set_enabled(acc, MINBIF_VERSION_NAME, true);
+	}
+
+	if(!timer_id && (!queue.empty() || !connecting.empty()))
+		timer_id = g_timeout_add(TICK, LoginScheduler::tick, NULL);
+}
+
+gboolean LoginScheduler::tick(void*)
+{
+	GTimeVal now;
+	g_get_current_time(&now);
+
+	/* Release slots of connections which never end. */
+	for(map<PurpleAccount*, GTimeVal>::iterator it = connecting.begin(); it != connecting.end();)
+		if(now.tv_sec - it->second.tv_sec > (glong)CONNECT_TIMEOUT)
+		{
+			b_log[W_WARNING] << "Connection to " << Account(it->first).getServername() << " is too long, connecting next accounts";
+			connecting.erase(it++);
+		}
+		else
+			++it;
+
+	/* The timer is still armed, so dispatch() does not add another one. */
+	dispatch();
+
+	if(queue.empty() && connecting.empty())
+	{
+		timer_id = 0;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+}; /* namespace im */
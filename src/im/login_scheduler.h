@@ -0,0 +1,116 @@
+/*
+ * Minbif - IRC instant messaging gateway
+ * Copyright(C) 2009-2010 Romain Bignon
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef IM_LOGIN_SCHEDULER_H
+#define IM_LOGIN_SCHEDULER_H
+
+#include <purple.h>
+#include <map>
+#include <vector>
+
+namespace im
+{
+	using std::map;
+	using std::vector;
+
+	class Account;
+
+	/** Schedule account connections.
+	 *
+	 * Instead of connecting every account at once (at startup, or
+	 * after a network failure), accounts are queued and only a few
+	 * of them connect at the same time. Failed connections are
+	 * retried with an exponential backoff, and accounts which were
+	 * connected successfully last time are connected first.
+	 */
+	class LoginScheduler
+	{
+		struct Entry
+		{
+			PurpleAccount* account;
+			time_t ready;              /**< do not connect before this time */
+		};
+
+		static vector<Entry> queue;
+		static map<PurpleAccount*, GTimeVal> connecting;
+		static map<PurpleAccount*, unsigned> failures;
+		static guint timer_id;
+
+		static unsigned long connects;
+		static unsigned long total_latency; /**< ms */
+		static unsigned long last_latency;  /**< ms */
+
+		static const unsigned MAX_CONNECTING = 3;
+		static const unsigned CONNECT_TIMEOUT = 120;  /**< s before a slot is released */
+		static const unsigned BACKOFF_BASE = 15;      /**< s */
+		static const unsigned BACKOFF_MAX = 3600;     /**< s */
+		static const unsigned TICK = 1000;            /**< ms */
+
+		static bool isHealthy(PurpleAccount* account);
+		static void setHealthy(PurpleAccount* account, bool healthy);
+		static void dispatch();
+		static gboolean tick(void*);
+
+	public:
+
+		static void init();
+		static void uninit();
+
+		/** Disable the enabled accounts, before libpurple restores
+		 * statuses, so they are connected later by the scheduler.
+		 */
+		static void hold();
+
+		/** Queue every account held by hold(). */
+		static void release();
+
+		/** Queue an account to be connected.
+		 *
+		 * @param account  account to connect
+		 * @param delay  seconds to wait before connecting it
+		 */
+		static void enqueue(const Account& account, unsigned delay = 0);
+
+		/** Queue an account after a connection failure.
+		 *
+		 * @return  number of seconds before the next try
+		 */
+		static unsigned retry(const Account& account);
+
+		/** Remove an account from the queue and forget its failures.
+		 *
+		 * @return  true if the account was queued
+		 */
+		static bool cancel(const Account& account);
+
+		/** The connection to this account is established. */
+		static void connected(const Account& account);
+
+		/** The connection to this account is closed or has failed. */
+		static void disconnected(const Account& account);
+
+		static size_t getQueueDepth() { return queue.size(); }
+		static size_t countConnecting() { return connecting.size(); }
+		static unsigned long countConnects() { return connects; }
+		static unsigned long getLastLatency() { return last_latency; }
+		static unsigned long getAverageLatency() { return connects ? total_latency / connects : 0; }
+	};
+
+}; /* namespace im */
+
+#endif /* IM_LOGIN_SCHEDULER_H */
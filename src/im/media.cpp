@@ -17,6 +17,14 @@
  */
 
 #include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#ifdef __linux__
+#  include <sys/eventfd.h>
+#endif
 #include "im/media.h"
 #include "im/im.h"
 #include "im/purple.h"
@@ -26,35 +34,140 @@
 #include "irc/buddy.h"
 #include "core/log.h"
 #include "core/caca_image.h"
+#include "core/caca_renderer.h"
 #include "core/util.h"
 #include "core/callback.h"
+#include "core/config.h"
 
 namespace im {
 
 #ifdef HAVE_VIDEO
 
+FrameRing::FrameRing(PurpleMedia* _media, int _wakeup_fd)
+	: media(_media),
+	  wakeup_fd(_wakeup_fd),
+	  write_pos(0),
+	  refs(1),
+	  dropped(0)
+{
+	for(unsigned i = 0; i < SIZE; ++i)
+		slots[i] = NULL;
+}
+
+FrameRing::~FrameRing()
+{
+	for(unsigned i = 0; i < SIZE; ++i)
+	{
+		Frame* frame = static_cast<Frame*>(slots[i]);
+		if(frame)
+		{
+			delete frame->image;
+			delete frame;
+		}
+	}
+}
+
+gpointer FrameRing::exchange(gpointer* slot, gpointer value)
+{
+	gpointer old;
+	do
+		old = g_atomic_pointer_get(slot);
+	while(!g_atomic_pointer_compare_and_exchange(slot, old, value));
+	return old;
+}
+
+void FrameRing::ref()
+{
+	g_atomic_int_inc(&refs);
+}
+
+void FrameRing::unref()
+{
+	if(g_atomic_int_dec_and_test(&refs))
+		delete this;
+}
+
+void FrameRing::release(gpointer data, GClosure*)
+{
+	static_cast<FrameRing*>(data)->unref();
+}
+
+void FrameRing::drop(Frame* frame)
+{
+	delete frame->image;
+	delete frame;
+	g_atomic_int_inc(&dropped);
+}
+
+void FrameRing::push(CacaImage* image)
+{
+	Frame* frame = new Frame;
+	frame->image = image;
+	frame->seq = write_pos++;
+
+	/* If the consumer didn't take the frame SIZE positions before,
+	 * it gets back here and is dropped. */
+	Frame* old = static_cast<Frame*>(exchange(&slots[frame->seq % SIZE], frame));
+	if(old)
+		drop(old);
+
+#ifdef __linux__
+	uint64_t one = 1;
+	(void)write(wakeup_fd, &one, sizeof one);
+#else
+	char one = 1;
+	(void)write(wakeup_fd, &one, sizeof one);
+#endif
+}
+
+CacaImage* FrameRing::pop()
+{
+	/* Every slot is taken, and only the newest frame is kept. Frames
+	 * pushed meanwhile in slots already read are left for the next
+	 * call, which their wakeup triggers. */
+	Frame* newest = NULL;
+	for(unsigned i = 0; i < SIZE; ++i)
+	{
+		Frame* frame = static_cast<Frame*>(exchange(&slots[i], NULL));
+		if(!frame)
+			continue;
+
+		if(!newest || (gint)(frame->seq - newest->seq) > 0)
+			std::swap(frame, newest);
+		if(frame)
+			drop(frame);
+	}
+
+	if(!newest)
+		return NULL;
+
+	CacaImage* image = newest->image;
+	delete newest;
+	return image;
+}
+
 MediaList::MediaList()
 	: Mutex(),
-	  check_cb(NULL),
-	  check_id(-1)
+	  wakeup_watch(-1)
 {
+	wakeup_fd[0] = wakeup_fd[1] = -1;
 }
 
 MediaList::~MediaList()
 {
-	if(check_id >= 0)
-		g_source_remove(check_id);
-	delete check_cb;
+	if(wakeup_watch >= 0)
+		g_source_remove(wakeup_watch);
+	for(vector<FrameRing*>::iterator it = rings.begin(); it != rings.end(); ++it)
+		(*it)->unref();
+	if(wakeup_fd[0] >= 0)
+		close(wakeup_fd[0]);
+	if(wakeup_fd[1] >= 0 && wakeup_fd[1] != wakeup_fd[0])
+		close(wakeup_fd[1]);
 }
 
 void MediaList::addMedia(const Media& media)
 {
 	BlockLockMutex m(this);
-	if(check_id < 0)
-	{
-		check_cb = new CallBack<MediaList>(this, &MediaList::check);
-		check_id = g_timeout_add(50, g_callback, check_cb);
-	}
 	medias.push_back(media);
 }
 
@@ -79,56 +192,129 @@ void MediaList::removeMedia(const Media& media)
 			it = medias.erase(it);
 		else
 			++it;
+
+	for(vector<FrameRing*>::iterator ring = rings.begin(); ring != rings.end(); )
+		if((*ring)->getPurpleMedia() == media.getPurpleMedia())
+		{
+			if((*ring)->getDropped())
+				b_log[W_INFO] << (*ring)->getDropped() << " video frames have been dropped";
+			(*ring)->unref();
+			ring = rings.erase(ring);
+		}
+		else
+			++ring;
 }
 
-void MediaList::enqueueBuffer(const Media& media, const CacaImage& buf)
+FrameRing* MediaList::createRing(PurpleMedia* media)
 {
 	BlockLockMutex m(this);
-	vector<Media>::iterator it;
-	for(it = medias.begin(); it != medias.end() && *it != media; ++it)
+	if(wakeup_fd[0] < 0)
+	{
+#ifdef __linux__
+		wakeup_fd[0] = wakeup_fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if(wakeup_fd[0] < 0)
+#else
+		if(pipe(wakeup_fd) < 0)
+#endif
+		{
+			b_log[W_ERR] << "Unable to create video wakeup fd: " << strerror(errno);
+			wakeup_fd[0] = wakeup_fd[1] = -1;
+			return NULL;
+		}
+#ifndef __linux__
+		for(unsigned i = 0; i < 2; ++i)
+		{
+			fcntl(wakeup_fd[i], F_SETFL, fcntl(wakeup_fd[i], F_GETFL) | O_NONBLOCK);
+			fcntl(wakeup_fd[i], F_SETFD, FD_CLOEXEC);
+		}
+#endif
+		wakeup_watch = glib_input_add(wakeup_fd[0], PURPLE_INPUT_READ, MediaList::wakeup_cb, this);
+	}
+
+	FrameRing* ring = new FrameRing(media, wakeup_fd[1]);
+	ring->ref(); /* for the sink */
+	rings.push_back(ring);
+	return ring;
+}
+
+void MediaList::wakeup_cb(gpointer data, gint fd, PurpleInputCondition)
+{
+	/* Only tells there are frames, they are all taken below. */
+	char buf[64];
+	while(read(fd, buf, sizeof buf) > 0)
 		;
 
-	if(it == medias.end())
+	static_cast<MediaList*>(data)->flush();
+}
+
+void MediaList::flush()
+{
+	BlockLockMutex m(this);
+	for(vector<FrameRing*>::iterator ring = rings.begin(); ring != rings.end(); ++ring)
 	{
-		b_log[W_WARNING] << "Trying to enqueue data to an unknown stream.";
-		return;
+		CacaImage* frame = (*ring)->pop();
+		if(!frame)
+			continue;
+
+		vector<Media>::iterator it;
+		for(it = medias.begin(); it != medias.end() && it->getPurpleMedia() != (*ring)->getPurpleMedia(); ++it)
+			;
+		if(it != medias.end())
+			it->showFrame(*frame);
+		delete frame;
 	}
-
-	it->enqueueBuffer(buf);
 }
 
-bool MediaList::check(void*)
+bool MediaList::rendered(void* data)
 {
+	CacaRenderer::Job* job = static_cast<CacaRenderer::Job*>(data);
 	BlockLockMutex m(this);
 	vector<Media>::iterator it;
-	for(it = medias.begin(); it != medias.end(); ++it)
-		it->checkBuffer();
+	for(it = medias.begin(); it != medias.end() && it->getPurpleMedia() != job->getData(); ++it)
+		;
+
+	/* The call may be terminated. */
+	if(it == medias.end())
+		return true;
 
+	if(job->hasFailed())
+		it->frameFailed();
+	else
+		it->sendFrame(job->getBuffer());
 	return true;
 }
 
 Media::Media()
 	: media(0),
-	  dcc(NULL)
+	  dcc(NULL),
+	  rendering(false),
+	  delta(false)
 {
 }
 
 Media::Media(PurpleMedia* m)
 	: media(m),
-	  dcc(NULL)
+	  dcc(NULL),
+	  rendering(false),
+	  delta(false)
 {}
 
 Media::Media(PurpleMedia* m, const Buddy& b)
 	: media(m),
 	  buddy(b),
-	  dcc(NULL)
+	  dcc(NULL),
+	  rendering(false),
+	  delta(false)
 {
 }
 
 Media::Media(const Media& m)
 	: media(m.media),
 	  buddy(m.buddy),
-	  dcc(NULL)
+	  dcc(NULL),
+	  rendering(m.rendering),
+	  delta(m.delta),
+	  next(m.next)
 {
 
 }
@@ -137,6 +323,10 @@ Media& Media::operator=(const Media& m)
 {
 	media = m.media;
 	buddy = m.buddy;
+	rendering = m.rendering;
+	delta = m.delta;
+	next = m.next;
+	screen.reset();
 	delete dcc;
 	dcc = NULL;
 	return *this;
@@ -157,32 +347,88 @@ bool Media::operator!=(const Media& m) const
 	return !this->media || this->media != m.media;
 }
 
-void Media::enqueueBuffer(const CacaImage& buf)
+void Media::showFrame(const CacaImage& frame)
 {
-	queue.push_back(buf);
+	if(rendering)
+		next = frame;
+	else
+		render(frame);
 }
 
-void Media::checkBuffer()
+bool Media::canSend()
 {
-	vector<CacaImage>::iterator it;
-	for(it = queue.begin(); it != queue.end(); it = queue.erase(it))
+	try
 	{
-		try
+		if(!dcc)
 		{
-			if(!dcc)
-			{
-				irc::IRC* irc = Purple::getIM()->getIRC();
-				irc::Buddy* sender = irc->getNick(buddy);
-				dcc = new irc::DCCChat(sender, irc->getUser());
-			}
-			string buf = it->getIRCBuffer(0, 20, "ansi"), line;
-			dcc->dcc_send(buf);
+			irc::IRC* irc = Purple::getIM()->getIRC();
+			irc::Buddy* sender = irc->getNick(buddy);
+			dcc = new irc::DCCChat(sender, irc->getUser());
 		}
-		catch(CacaError &e)
+	}
+	catch(irc::DCCListenError &e)
+	{
+		b_log[W_ERR] << "Unable to listen for DCC, video can't be sent to user";
+		return false;
+	}
+
+	return dcc->isConnected() && dcc->getBacklog() <= MAX_BACKLOG;
+}
+
+void Media::render(const CacaImage& frame)
+{
+	/* Nobody to show it to yet, or the link is late. */
+	if(!canSend())
+		return;
+
+	try
+	{
+		delta = conf.GetSection("file_transfers")->GetItem("dcc_video_delta")->Boolean();
+		CacaRenderer::render(frame, 0, 20, delta ? CacaImage::CELLS : "ansi",
+		                     &media_list, &MediaList::rendered, media);
+		rendering = true;
+	}
+	catch(CacaNotLoaded &e)
+	{
+		b_log[W_ERR] << "libcaca is required to display video";
+	}
+}
+
+void Media::sendFrame(const string& buf)
+{
+	rendering = false;
+	if(dcc && dcc->isConnected())
+	{
+		if(delta)
+			dcc->dcc_send(screen.update(buf));
+		else
 		{
-			b_log[W_ERR] << "Caca error while sending to user";
+			/* Full frames are printed wherever the cursor is, so
+			 * the next delta one redraws the whole screen. */
+			screen.reset();
+			dcc->dcc_send(buf);
 		}
 	}
+
+	if(next.isValid())
+	{
+		CacaImage frame = next;
+		next = CacaImage();
+		render(frame);
+	}
+}
+
+void Media::frameFailed()
+{
+	rendering = false;
+	b_log[W_ERR] << "Caca error while sending to user";
+
+	if(next.isValid())
+	{
+		CacaImage frame = next;
+		next = CacaImage();
+		render(frame);
+	}
 }
 
 #endif /* HAVE_VIDEO */
@@ -401,7 +647,7 @@ void Media::got_data(GstElement* object,
 {
 	try
 	{
-		gint w, h;
+		gint w = 0, h = 0;
 		guint bpp = 0;
 		GstStructure* structure = gst_caps_get_structure (buffer->caps, 0);
 		gst_structure_get_int (structure, "width", &w);
@@ -410,8 +656,19 @@ void Media::got_data(GstElement* object,
 		if(!bpp)
 			bpp = 8;
 
-		CacaImage img(GST_BUFFER_DATA(buffer), GST_BUFFER_SIZE(buffer), w, h, bpp);
-		Media::media_list.enqueueBuffer(Media((PurpleMedia*)user_data), img);
+		/* Truncated frames can't be rendered, drop them here. */
+		if(w <= 0 || h <= 0 || GST_BUFFER_SIZE(buffer) < (guint)w * h * (bpp / 8))
+			return;
+
+		CacaImage* frame = new CacaImage(GST_BUFFER_DATA(buffer), GST_BUFFER_SIZE(buffer), w, h, bpp);
+		if(!frame->isValid())
+		{
+			delete frame;
+			return;
+		}
+
+		FrameRing* ring = static_cast<FrameRing*>(user_data);
+		ring->push(frame);
 	}
 	catch(CacaError& e)
 	{
@@ -425,8 +682,14 @@ GstElement *Media::create_default_video_sink(PurpleMedia *media,
 
 	ffmpegcolorspace = gst_element_factory_make("ffmpegcolorspace", NULL);
 	fakesink = gst_element_factory_make("fakesink", NULL);
-	g_object_set(G_OBJECT(fakesink), "signal-handoffs", TRUE, NULL);
-	g_signal_connect(fakesink, "handoff", G_CALLBACK(got_data), media);
+
+	FrameRing* ring = media_list.createRing(media);
+	if(ring)
+	{
+		g_object_set(G_OBJECT(fakesink), "signal-handoffs", TRUE, NULL);
+		g_signal_connect_data(fakesink, "handoff", G_CALLBACK(got_data), ring,
+		                      FrameRing::release, (GConnectFlags)0);
+	}
 
 	gst_element_link_many(ffmpegcolorspace, fakesink, NULL);
 
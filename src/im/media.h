@@ -29,6 +29,7 @@
 #include <media-gst.h>
 #include "im/buddy.h"
 #include "core/caca_image.h"
+#include "core/ansi_screen.h"
 #endif
 
 class _CallBack;
@@ -43,12 +44,78 @@ namespace im {
 	using std::string;
 
 #ifdef HAVE_VIDEO
+	/** Frames received by a video sink.
+	 *
+	 * The GStreamer streaming thread pushes frames, and the main loop
+	 * pops them, without any lock. It holds at most SIZE frames: when
+	 * it is full, the producer drops the oldest one, so it never
+	 * waits and memory stays bounded.
+	 *
+	 * The producer may refill slots while the consumer reads them, so
+	 * frames are tagged with their sequence number, which tells which
+	 * one is the newest.
+	 *
+	 * It is referenced by the sink's signal handler and by the
+	 * MediaList, which may be released from different threads.
+	 */
+	class FrameRing
+	{
+	public:
+		static const unsigned SIZE = 4;
+
+	private:
+		struct Frame
+		{
+			CacaImage* image;
+			guint seq;
+		};
+
+		PurpleMedia* media;
+		int wakeup_fd;
+		gpointer slots[SIZE];  /**< Frame*, NULL once popped */
+		guint write_pos;       /**< only used by the producer */
+		gint refs;
+		gint dropped;
+
+		static gpointer exchange(gpointer* slot, gpointer value);
+		void drop(Frame* frame);
+
+	public:
+
+		FrameRing(PurpleMedia* media, int wakeup_fd);
+		~FrameRing();
+
+		void ref();
+		void unref();
+
+		/** GClosureNotify used to release the sink's reference. */
+		static void release(gpointer data, GClosure* closure);
+
+		/** Called from the streaming thread. The ring takes the
+		 * ownership of the frame. */
+		void push(CacaImage* frame);
+
+		/** Called from the main loop.
+		 *
+		 * @return  the newest frame, which the caller has to
+		 *          delete, or NULL. Older ones are dropped.
+		 */
+		CacaImage* pop();
+
+		PurpleMedia* getPurpleMedia() const { return media; }
+		unsigned getDropped() { return (unsigned)g_atomic_int_get(&dropped); }
+	};
+
 	class Media;
 	class MediaList : public Mutex
 	{
 		vector<Media> medias;
-		_CallBack* check_cb;
-		int check_id;
+		vector<FrameRing*> rings;
+		int wakeup_fd[2];      /**< the same eventfd twice, or a pipe */
+		int wakeup_watch;
+
+		static void wakeup_cb(gpointer data, gint fd, PurpleInputCondition cond);
+		void flush();
 	public:
 
 		MediaList();
@@ -57,9 +124,12 @@ namespace im {
 		void addMedia(const Media& media);
 		void removeMedia(const Media& media);
 		Media getMedia(PurpleMedia* m);
-		void enqueueBuffer(const Media& media, const CacaImage& buf);
 
-		bool check(void*);
+		/** Create a ring for a new video sink of a media. */
+		FrameRing* createRing(PurpleMedia* media);
+
+		/** Callback when a frame is rendered. */
+		bool rendered(void*);
 	};
 #endif /* HAVE_VIDEO */
 
@@ -68,8 +138,15 @@ namespace im {
 #ifdef HAVE_VIDEO
 		PurpleMedia* media;
 		Buddy buddy;
-		vector<CacaImage> queue;
 		irc::DCCChat* dcc;
+		bool rendering;      /**< a frame is being rendered */
+		bool delta;          /**< it is rendered for the screen */
+		CacaImage next;      /**< frame to render after this one */
+		AnsiScreen screen;   /**< what the IRC user's terminal displays */
+
+		/** Frames are not rendered while the IRC user hasn't
+		 * received this amount of previous ones (bytes). */
+		static const size_t MAX_BACKLOG = 16 * 1024;
 
 		static MediaList media_list;
 		static bool gstreamer_init_failed;
@@ -84,6 +161,9 @@ namespace im {
 
 		static void minbif_media_state_changed_cb(PurpleMedia *media, PurpleMediaState state,
 				gchar *sid, gchar *name, void* gtkmedia);
+		bool canSend();
+		void render(const CacaImage& frame);
+
 		static void got_data(GstElement* object,
 				GstBuffer* buffer,
 				GstPad* arg1,
@@ -108,8 +188,17 @@ namespace im {
 
 		bool isValid() const { return media; }
 
-		void enqueueBuffer(const CacaImage& buf);
-		void checkBuffer();
+		/** A new frame is received. Frames are rendered one at a
+		 * time, and when it is done, older ones are late, so only
+		 * the last received one is rendered next.
+		 *
+		 * Frames are dropped while the DCC link is late, so the
+		 * frame rate follows what it can carry. */
+		void showFrame(const CacaImage& frame);
+
+		/** Send a rendered frame to the IRC user. */
+		void sendFrame(const string& buf);
+		void frameFailed();
 		Buddy getBuddy() const { return buddy; }
 		PurpleMedia* getPurpleMedia() const { return media; }
 #endif /* HAVE_VIDEO */
@@ -27,16 +27,26 @@
 #include "roomlist.h"
 #include "ft.h"
 #include "media.h"
+#include "login_scheduler.h"
+#include "send_scheduler.h"
 #include "irc/irc.h"
 #include "irc/buddy_icon.h"
 #include "core/version.h"
 #include "core/log.h"
 #include "core/util.h"
 #include "core/config.h"
+#include "core/caca_renderer.h"
 
 namespace im {
 
 IM* Purple::im = NULL;
+map<string, Protocol> Purple::protocols;
+map<string, Protocol> Purple::purple_protocols;
+bool Purple::protocols_dirty = true;
+map<string, Account> Purple::accounts;
+map<string, Account> Purple::accounts_by_name;
+map<string, Account> Purple::accounts_by_channel;
+bool Purple::accounts_dirty = true;
 
 PurpleEventLoopUiOps Purple::eventloop_ops =
 {
@@ -151,8 +161,24 @@ void Purple::init(IM* im)
 	purple_blist_load();
 }
 
+void* Purple::getHandler()
+{
+	static int handler;
+
+	return &handler;
+}
+
 void Purple::inited()
 {
+	purple_signal_connect(purple_plugins_get_handle(), "plugin-load",
+				getHandler(), PURPLE_CALLBACK(plugin_changed),
+				NULL);
+	purple_signal_connect(purple_plugins_get_handle(), "plugin-unload",
+				getHandler(), PURPLE_CALLBACK(plugin_changed),
+				NULL);
+	protocols_dirty = true;
+	accounts_dirty = true;
+
 	Account::init();
 	RoomList::init();
 	Buddy::init();
@@ -160,6 +186,7 @@ void Purple::inited()
 	Request::init();
 	FileTransfert::init();
 	Media::init();
+	LoginScheduler::init();
 
 	irc::IRC* irc = getIM()->getIRC();
 	irc::BuddyIcon* bi = new irc::BuddyIcon(getIM(), irc);
@@ -177,6 +204,7 @@ void Purple::uninit()
 
 	if(ui_info)
 		g_hash_table_destroy(ui_info);
+	purple_signals_disconnect_by_handle(getHandler());
 	Account::uninit();
 	RoomList::uninit();
 	Buddy::uninit();
@@ -184,6 +212,9 @@ void Purple::uninit()
 	Request::uninit();
 	FileTransfert::uninit();
 	Media::uninit();
+	LoginScheduler::uninit();
+	SendScheduler::uninit();
+	CacaRenderer::uninit();
 }
 
 map<string, Plugin> Purple::getPluginsList()
@@ -214,48 +245,108 @@ map<string, Plugin> Purple::getPluginsList()
 	return m;
 }
 
-map<string, Protocol> Purple::getProtocolsList()
+void Purple::plugin_changed(PurplePlugin* plugin)
 {
-	map<string, Protocol> m;
-	GList* list = purple_plugins_get_protocols();
+	if(plugin->info && plugin->info->type == PURPLE_PLUGIN_PROTOCOL)
+	{
+		protocols_dirty = true;
+		accounts_dirty = true;
+	}
+}
 
-	for(; list; list = list->next)
+void Purple::updateProtocols()
+{
+	protocols.clear();
+	purple_protocols.clear();
+
+	for(GList* list = purple_plugins_get_protocols(); list; list = list->next)
 	{
 		Protocol protocol = Protocol((PurplePlugin*)list->data);
-		m[protocol.getID()] = protocol;
+		protocols[protocol.getID()] = protocol;
+		purple_protocols[protocol.getPurpleID()] = protocol;
 	}
 
-	return m;
+	protocols_dirty = false;
 }
 
-map<string, Account> Purple::getAccountsList()
+const map<string, Protocol>& Purple::getProtocolsList()
 {
-	map<string, Account> m;
-	GList* list = purple_accounts_get_all();
-	map<string, Protocol> protocols = getProtocolsList();
+	if(protocols_dirty)
+		updateProtocols();
+
+	return protocols;
+}
+
+Protocol Purple::getProtocolByPurpleID(string id)
+{
+	if(protocols_dirty)
+		updateProtocols();
+
+	map<string, Protocol>::const_iterator it = purple_protocols.find(id);
+	if(it == purple_protocols.end())
+		return Protocol();
+	else
+		return it->second;
+}
+
+void Purple::updateAccounts()
+{
+	accounts.clear();
+	accounts_by_name.clear();
+	accounts_by_channel.clear();
 
-	for(; list; list = list->next)
+	for(GList* list = purple_accounts_get_all(); list; list = list->next)
 	{
 		Protocol proto = getProtocolByPurpleID(((PurpleAccount*)list->data)->protocol_id);
 		if(!proto.isValid())
 			continue;
 
 		Account account = Account((PurpleAccount*)list->data, proto);
-		m[account.getID()] = account;
+		accounts[account.getID()] = account;
 	}
 
-	return m;
+	/* Insertion does not replace existing keys, so when several
+	 * accounts match, the first one by ID wins. */
+	for(map<string, Account>::iterator it = accounts.begin(); it != accounts.end(); ++it)
+	{
+		accounts_by_name.insert(std::make_pair(it->first, it->second));
+		accounts_by_name.insert(std::make_pair(it->second.getServername(), it->second));
+		accounts_by_channel.insert(std::make_pair(it->second.getStatusChannelName(), it->second));
+	}
+
+	accounts_dirty = false;
 }
 
-Protocol Purple::getProtocolByPurpleID(string id)
+const map<string, Account>& Purple::getAccountsList()
 {
-	GList* list = purple_plugins_get_protocols();
+	if(accounts_dirty)
+		updateAccounts();
 
-	for(; list; list = list->next)
-		if(id == ((PurplePlugin*)list->data)->info->id)
-			return Protocol((PurplePlugin*)list->data);
+	return accounts;
+}
 
-	return Protocol();
+Account Purple::getAccount(const string& name)
+{
+	if(accounts_dirty)
+		updateAccounts();
+
+	map<string, Account>::const_iterator it = accounts_by_name.find(name);
+	if(it == accounts_by_name.end())
+		return Account();
+	else
+		return it->second;
+}
+
+Account Purple::getAccountFromChannel(const string& name)
+{
+	if(accounts_dirty)
+		updateAccounts();
+
+	map<string, Account>::const_iterator it = accounts_by_channel.find(name);
+	if(it == accounts_by_channel.end())
+		return Account();
+	else
+		return it->second;
 }
 
 string Purple::getNewAccountName(Protocol proto, const Account& butone)
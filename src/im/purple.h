@@ -66,6 +66,21 @@ namespace im
 		static void debug_init();
 		static void debug(PurpleDebugLevel level, const char *category, const char *args);
 
+		static void* getHandler();
+
+		/* Registries are rebuilt lazily from libpurple once invalidated. */
+		static map<string, Protocol> protocols;         /**< by minbif ID */
+		static map<string, Protocol> purple_protocols;  /**< by purple ID */
+		static bool protocols_dirty;
+		static void updateProtocols();
+		static void plugin_changed(PurplePlugin* plugin);
+
+		static map<string, Account> accounts;           /**< by ID */
+		static map<string, Account> accounts_by_name;   /**< by ID and servername */
+		static map<string, Account> accounts_by_channel;/**< by status channel name */
+		static bool accounts_dirty;
+		static void updateAccounts();
+
 	public:
 
 		/** Initialization */
@@ -82,10 +97,26 @@ namespace im
 		 *
 		 * @return  map with first=id, second=Protocol object
 		 */
-		static map<string, Protocol> getProtocolsList();
+		static const map<string, Protocol>& getProtocolsList();
 		static Protocol getProtocolByPurpleID(string id);
 
-		static map<string, Account> getAccountsList();
+		/** Get accounts list
+		 *
+		 * @return  map with first=id, second=Account object
+		 */
+		static const map<string, Account>& getAccountsList();
+
+		/** Get an account from its ID or its servername. */
+		static Account getAccount(const string& name);
+
+		/** Get the first account (by ID) which uses this status channel. */
+		static Account getAccountFromChannel(const string& name);
+
+		/** Called when an account is added or removed, or when its
+		 * ID or status channel has changed.
+		 */
+		static void invalidateAccounts() { accounts_dirty = true; }
+
 		static Account addAccount(const Protocol& proto, const string& username, const Protocol::Options& options, bool register_account);
 		static void delAccount(PurpleAccount* account);
 		static string getNewAccountName(Protocol proto, const Account& butone = Account());
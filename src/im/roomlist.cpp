@@ -16,6 +16,10 @@
  * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 
+#include <cstring>
+#include <ctime>
+#include <fnmatch.h>
+
 #include "im/roomlist.h"
 #include "im/conversation.h"
 #include "im/purple.h"
@@ -27,6 +31,75 @@
 
 namespace im {
 
+map<PurpleAccount*, RoomList::Cache> RoomList::caches;
+map<PurpleAccount*, RoomList::Filter> RoomList::requests;
+
+/* FILTER */
+
+RoomList::Filter::Filter(string filter)
+	: min_users(-1),
+	  max_users(-1)
+{
+	string token;
+	while((token = stringtok(filter, ",")).empty() == false)
+	{
+		switch(token[0])
+		{
+			case '>':
+				min_users = s2t<int>(token.substr(1));
+				break;
+			case '<':
+				max_users = s2t<int>(token.substr(1));
+				break;
+			case '!':
+				if(token.size() > 1)
+					not_masks.push_back(token.substr(1));
+				break;
+			default:
+				masks.push_back(token);
+				break;
+		}
+	}
+}
+
+bool RoomList::Filter::isFilter(const string& token)
+{
+	return !token.empty() &&
+	       (token[0] == '>' || token[0] == '<' || token[0] == '!' ||
+		token.find_first_of("*?") != string::npos);
+}
+
+bool RoomList::Filter::match(const Room& room) const
+{
+	return match(room.name, room.users);
+}
+
+bool RoomList::Filter::match(const string& name, int users) const
+{
+	/* Rooms without users count are not filtered on it. */
+	if(users >= 0)
+	{
+		if(min_users >= 0 && users <= min_users)
+			return false;
+		if(max_users >= 0 && users >= max_users)
+			return false;
+	}
+
+	vector<string>::const_iterator it;
+	for(it = not_masks.begin(); it != not_masks.end(); ++it)
+		if(!fnmatch(it->c_str(), name.c_str(), FNM_NOESCAPE|FNM_CASEFOLD))
+			return false;
+
+	if(masks.empty())
+		return true;
+
+	for(it = masks.begin(); it != masks.end(); ++it)
+		if(!fnmatch(it->c_str(), name.c_str(), FNM_NOESCAPE|FNM_CASEFOLD))
+			return true;
+
+	return false;
+}
+
 /* METHODS */
 
 RoomList::RoomList(PurpleRoomlist* rl)
@@ -40,8 +113,62 @@ RoomList::~RoomList()
 
 }
 
+void RoomList::sendStart(const string& fields)
+{
+	irc::IRC* irc = Purple::getIM()->getIRC();
+	irc->getUser()->send(irc::Message(RPL_LISTSTART).setSender(irc)
+					                .setReceiver(irc->getUser())
+					                .addArg("Channel")
+					                .addArg(fields));
+}
+
+void RoomList::sendRoom(const Room& room)
+{
+	irc::IRC* irc = Purple::getIM()->getIRC();
+	irc->getUser()->send(irc::Message(RPL_LIST).setSender(irc)
+				                   .setReceiver(irc->getUser())
+				                   .addArg(room.name)
+				                   .addArg(room.info));
+}
+
+void RoomList::sendEnd()
+{
+	irc::IRC* irc = Purple::getIM()->getIRC();
+	irc->getUser()->send(irc::Message(RPL_LISTEND).setSender(irc)
+						      .setReceiver(irc->getUser())
+						      .addArg("End of /LIST"));
+}
+
+void RoomList::display(const Account& account, const Filter& filter, bool refresh)
+{
+	map<PurpleAccount*, Cache>::iterator it = caches.find(account.getPurpleAccount());
+	if(!refresh && it != caches.end() && it->second.complete && time(NULL) - it->second.date < CACHE_TTL)
+	{
+		sendStart(it->second.fields);
+		for(vector<Room>::iterator room = it->second.rooms.begin(); room != it->second.rooms.end(); ++room)
+			if(filter.match(*room))
+				sendRoom(*room);
+		sendEnd();
+		return;
+	}
+
+	requests[account.getPurpleAccount()] = filter;
+	purple_roomlist_get_list(account.getPurpleConnection());
+}
+
+void RoomList::clearCache(const Account& account)
+{
+	caches.erase(account.getPurpleAccount());
+	requests.erase(account.getPurpleAccount());
+}
+
 void RoomList::create(PurpleRoomlist* list)
 {
+	Cache& cache = caches[list->account];
+	cache.date = time(NULL);
+	cache.complete = false;
+	cache.fields.clear();
+	cache.rooms.clear();
 }
 
 void RoomList::set_fields(PurpleRoomlist* list, GList* fields)
@@ -54,11 +181,9 @@ void RoomList::set_fields(PurpleRoomlist* list, GList* fields)
 		if(!f->hidden)
 			str += string(f->label) + " ";
 	}
-	irc::IRC* irc = Purple::getIM()->getIRC();
-	irc->getUser()->send(irc::Message(RPL_LISTSTART).setSender(irc)
-					                .setReceiver(irc->getUser())
-					                .addArg("Channel")
-					                .addArg(str));
+
+	caches[list->account].fields = str;
+	sendStart(str);
 }
 
 void RoomList::add_room(PurpleRoomlist* list, PurpleRoomlistRoom* room)
@@ -68,7 +193,7 @@ void RoomList::add_room(PurpleRoomlist* list, PurpleRoomlistRoom* room)
 		return;
 
 	char* name;
-	string str;
+	Room r;
 	PurplePluginProtocolInfo* prpl_info = PURPLE_PLUGIN_PROTOCOL_INFO(purple_connection_get_prpl(gc));
 
 	if(prpl_info != NULL && prpl_info->roomlist_room_serialize)
@@ -76,6 +201,10 @@ void RoomList::add_room(PurpleRoomlist* list, PurpleRoomlistRoom* room)
 	else
 		name = g_strdup(purple_roomlist_room_get_name(room));
 
+	r.name = Conversation::normalizeIRCName(name, Account(list->account));
+	r.users = -1;
+	g_free(name);
+
 	GList *iter, *field;
 	for (iter = purple_roomlist_room_get_fields(room),
 	     field = purple_roomlist_get_fields(list);
@@ -84,39 +213,45 @@ void RoomList::add_room(PurpleRoomlist* list, PurpleRoomlistRoom* room)
 	{
 		PurpleRoomlistField *f = (PurpleRoomlistField*)field->data;
 
+		/* Users count is the 'users' field, or the first integer one. */
+		if (purple_roomlist_field_get_type(f) == PURPLE_ROOMLIST_FIELD_INT &&
+		    (r.users < 0 || (f->name && !strcmp(f->name, "users"))))
+			r.users = (int)(size_t)iter->data;
+
 		if (purple_roomlist_field_get_hidden(f))
 			continue;
 
 		switch (purple_roomlist_field_get_type(f)) {
 			case PURPLE_ROOMLIST_FIELD_BOOL:
-				str += iter->data ? "True " : "False ";
+				r.info += iter->data ? "True " : "False ";
 				break;
 			case PURPLE_ROOMLIST_FIELD_INT:
-				str += t2s((size_t)iter->data) + " ";
+				r.info += t2s((size_t)iter->data) + " ";
 				break;
 			case PURPLE_ROOMLIST_FIELD_STRING:
-				str += string((const char*)iter->data) + " ";
+				r.info += string((const char*)iter->data) + " ";
 				break;
 		}
 	}
 
-	irc::IRC* irc = Purple::getIM()->getIRC();
-	irc->getUser()->send(irc::Message(RPL_LIST).setSender(irc)
-				                   .setReceiver(irc->getUser())
-				                   .addArg(Conversation::normalizeIRCName(name, Account(list->account)))
-				                   .addArg(str));
+	caches[list->account].rooms.push_back(r);
 
-	g_free(name);
+	/* Every room is cached, but only matching ones are sent. */
+	map<PurpleAccount*, Filter>::iterator req = requests.find(list->account);
+	if(req == requests.end() || req->second.match(r))
+		sendRoom(r);
 }
 
 void RoomList::in_progress(PurpleRoomlist* list, gboolean flag)
 {
 	if(!flag)
 	{
-		irc::IRC* irc = Purple::getIM()->getIRC();
-		irc->getUser()->send(irc::Message(RPL_LISTEND).setSender(irc)
-							      .setReceiver(irc->getUser())
-							      .addArg("End of /LIST"));
+		Cache& cache = caches[list->account];
+		cache.complete = true;
+		cache.date = time(NULL);
+		requests.erase(list->account);
+
+		sendEnd();
 	}
 }
 
@@ -149,6 +284,8 @@ void RoomList::init()
 void RoomList::uninit()
 {
 	purple_roomlist_set_ui_ops(NULL);
+	caches.clear();
+	requests.clear();
 }
 
 } /* ns im */
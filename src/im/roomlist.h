@@ -21,12 +21,69 @@
 
 #include <purple.h>
 #include <string>
+#include <vector>
+#include <map>
 
 namespace im {
 
 	using std::string;
+	using std::vector;
+	using std::map;
+	class Account;
+
 	class RoomList
 	{
+	public:
+
+		/** A room, as sent in a RPL_LIST reply. */
+		struct Room
+		{
+			string name;       /**< IRC channel name */
+			int users;         /**< number of users, or -1 if unknown */
+			string info;
+		};
+
+		/** ELIST-like filter.
+		 *
+		 * Tokens are separated by commas:
+		 * - '>n': more than n users;
+		 * - '<n': less than n users;
+		 * - 'mask': the name matches this mask;
+		 * - '!mask': the name does not match this mask.
+		 */
+		class Filter
+		{
+			int min_users;
+			int max_users;
+			vector<string> masks;
+			vector<string> not_masks;
+
+		public:
+			Filter(string filter = "");
+
+			/** Check if a token looks like a filter and not like an account name. */
+			static bool isFilter(const string& token);
+
+			bool match(const Room& room) const;
+			bool match(const string& name, int users) const;
+		};
+
+	private:
+
+		/** Rooms received from an account. */
+		struct Cache
+		{
+			time_t date;
+			bool complete;
+			string fields;
+			vector<Room> rooms;
+		};
+
+		static map<PurpleAccount*, Cache> caches;
+		static map<PurpleAccount*, Filter> requests;
+
+		static const time_t CACHE_TTL = 600; /**< seconds */
+
 		PurpleRoomlist* rlist;
 
 		static PurpleRoomlistUiOps ui_ops;
@@ -36,11 +93,29 @@ namespace im {
 		static void in_progress(PurpleRoomlist* list, gboolean flag);
 		static void destroy(PurpleRoomlist* list);
 
+		static void sendStart(const string& fields);
+		static void sendRoom(const Room& room);
+		static void sendEnd();
+
 	public:
 
 		static void init();
 		static void uninit();
 
+		/** Send the room list of an account to the IRC user.
+		 *
+		 * The list is taken from cache if it is recent enough,
+		 * otherwise it is requested to the server.
+		 *
+		 * @param account  the account
+		 * @param filter  ELIST filter applied to rooms
+		 * @param refresh  ignore the cache
+		 */
+		static void display(const Account& account, const Filter& filter, bool refresh = false);
+
+		/** Forget the room list of an account. */
+		static void clearCache(const Account& account);
+
 		RoomList(PurpleRoomlist* rl);
 		~RoomList();
 	};
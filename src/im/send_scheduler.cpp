@@ -0,0 +1,211 @@
+/*
+ * Minbif - IRC instant messaging gateway
+ * Copyright(C) 2009-2010 Romain Bignon
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "im/send_scheduler.h"
+#include "im/account.h"
+
+namespace im {
+
+const SendScheduler::Limits SendScheduler::limits[] = {
+	/* purple id     burst rate  max length */
+	{ "prpl-irc",     4,   0.5,  400 },
+	{ "prpl-aim",     5,   1.0,  2000 },
+	{ "prpl-icq",     5,   1.0,  2000 },
+	{ "prpl-msn",     5,   1.0,  1400 },
+	{ "prpl-jabber",  10,  5.0,  0 },
+	{ NULL,           10,  2.0,  0 }
+};
+
+map<PurpleAccount*, SendScheduler::Bucket> SendScheduler::buckets;
+guint SendScheduler::timer_id = 0;
+
+void SendScheduler::uninit()
+{
+	if(timer_id)
+		g_source_remove(timer_id);
+	timer_id = 0;
+	buckets.clear();
+}
+
+const SendScheduler::Limits& SendScheduler::getLimits(const Account& account)
+{
+	size_t i;
+	string id = account.getProtocol().isValid() ? account.getProtocol().getPurpleID() : "";
+	for(i = 0; limits[i].purple_id != NULL && id != limits[i].purple_id; ++i)
+		;
+	return limits[i];
+}
+
+void SendScheduler::refill(Bucket& bucket, const Limits& l)
+{
+	GTimeVal now;
+	g_get_current_time(&now);
+
+	double elapsed = (now.tv_sec - bucket.last.tv_sec) + (now.tv_usec - bucket.last.tv_usec) / 1000000.0;
+	bucket.last = now;
+	if(elapsed <= 0)
+		return;
+
+	bucket.tokens += elapsed * l.rate;
+	if(bucket.tokens > l.burst)
+		bucket.tokens = l.burst;
+}
+
+vector<string> SendScheduler::split(const string& text, size_t max_length)
+{
+	vector<string> parts;
+	if(!max_length || text.size() <= max_length)
+	{
+		parts.push_back(text);
+		return parts;
+	}
+
+	size_t start = 0;
+	while(start < text.size())
+	{
+		size_t end = start + max_length;
+		if(end >= text.size())
+		{
+			parts.push_back(text.substr(start));
+			break;
+		}
+
+		/* Cut after the last line end, if any. */
+		size_t nl = text.rfind('\n', end - 1);
+		if(nl != string::npos && nl >= start)
+		{
+			if(nl > start)
+				parts.push_back(text.substr(start, nl - start));
+			start = nl + 1;
+			continue;
+		}
+
+		/* Do not cut inside an UTF-8 sequence. */
+		while(end > start + 1 && ((unsigned char)text[end] & 0xC0) == 0x80)
+			--end;
+
+		parts.push_back(text.substr(start, end - start));
+		start = end;
+	}
+
+	return parts;
+}
+
+void SendScheduler::send(const Conversation& conv, const string& text)
+{
+	/* Typing notifications are not rate limited. */
+	if(text.find("\001TYPING ") == 0)
+	{
+		Conversation(conv).sendMessage(text);
+		return;
+	}
+
+	Account account = conv.getAccount();
+	const Limits& l = getLimits(account);
+	bool is_new = buckets.find(account.getPurpleAccount()) == buckets.end();
+	Bucket& bucket = buckets[account.getPurpleAccount()];
+
+	if(is_new)
+	{
+		bucket.tokens = l.burst;
+		g_get_current_time(&bucket.last);
+	}
+	else
+		refill(bucket, l);
+
+	/* CTCP messages are never split. */
+	vector<string> parts;
+	if(!text.empty() && text[0] == '\001')
+		parts.push_back(text);
+	else
+		parts = split(text, l.max_length);
+
+	for(vector<string>::iterator it = parts.begin(); it != parts.end(); ++it)
+	{
+		if(bucket.queue.empty() && bucket.tokens >= 1)
+		{
+			bucket.tokens -= 1;
+			Conversation(conv).sendMessage(*it);
+		}
+		else
+		{
+			Pending p;
+			p.conv = conv;
+			p.text = *it;
+			bucket.queue.push_back(p);
+		}
+	}
+
+	if(!bucket.queue.empty() && !timer_id)
+		timer_id = g_timeout_add(TICK, SendScheduler::tick, NULL);
+}
+
+void SendScheduler::forget(const Conversation& conv)
+{
+	for(map<PurpleAccount*, Bucket>::iterator it = buckets.begin(); it != buckets.end(); ++it)
+	{
+		deque<Pending>& queue = it->second.queue;
+		for(deque<Pending>::iterator p = queue.begin(); p != queue.end();)
+			if(p->conv.getPurpleConversation() == conv.getPurpleConversation())
+				p = queue.erase(p);
+			else
+				++p;
+	}
+}
+
+size_t SendScheduler::getQueueDepth(const Account& account)
+{
+	map<PurpleAccount*, Bucket>::iterator it = buckets.find(account.getPurpleAccount());
+	if(it == buckets.end())
+		return 0;
+	else
+		return it->second.queue.size();
+}
+
+gboolean SendScheduler::tick(void*)
+{
+	bool pending = false;
+
+	for(map<PurpleAccount*, Bucket>::iterator it = buckets.begin(); it != buckets.end(); ++it)
+	{
+		Bucket& bucket = it->second;
+		if(bucket.queue.empty())
+			continue;
+
+		refill(bucket, getLimits(Account(it->first)));
+		while(!bucket.queue.empty() && bucket.tokens >= 1)
+		{
+			Pending p = bucket.queue.front();
+			bucket.queue.pop_front();
+			bucket.tokens -= 1;
+			p.conv.sendMessage(p.text);
+		}
+
+		if(!bucket.queue.empty())
+			pending = true;
+	}
+
+	if(!pending)
+	{
+		timer_id = 0;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+}; /* namespace im */
@@ -0,0 +1,101 @@
+/*
+ * Minbif - IRC instant messaging gateway
+ * Copyright(C) 2009-2010 Romain Bignon
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef IM_SEND_SCHEDULER_H
+#define IM_SEND_SCHEDULER_H
+
+#include <purple.h>
+#include <string>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "im/conversation.h"
+
+namespace im
+{
+	using std::string;
+	using std::deque;
+	using std::map;
+	using std::vector;
+
+	class Account;
+
+	/** Rate limit outgoing messages of each account.
+	 *
+	 * Every account has a token bucket, with a burst size and a rate
+	 * depending on its protocol. A message is sent immediately when a
+	 * token is available, otherwise it waits in the account's queue.
+	 * Bodies larger than the protocol limit are split.
+	 */
+	class SendScheduler
+	{
+		struct Pending
+		{
+			Conversation conv;
+			string text;
+		};
+
+		struct Bucket
+		{
+			double tokens;
+			GTimeVal last;
+			deque<Pending> queue;
+		};
+
+		struct Limits
+		{
+			const char* purple_id;
+			unsigned burst;       /**< maximum number of tokens */
+			double rate;          /**< tokens per second */
+			size_t max_length;    /**< bytes per message, 0 for no limit */
+		};
+
+		static const Limits limits[];
+		static map<PurpleAccount*, Bucket> buckets;
+		static guint timer_id;
+
+		static const unsigned TICK = 100; /**< ms */
+
+		static const Limits& getLimits(const Account& account);
+		static void refill(Bucket& bucket, const Limits& limits);
+		static gboolean tick(void*);
+
+	public:
+
+		static void uninit();
+
+		/** Send a message, now or when the account's rate allows it. */
+		static void send(const Conversation& conv, const string& text);
+
+		/** Drop queued messages of a destroyed conversation. */
+		static void forget(const Conversation& conv);
+
+		/** Number of messages waiting for this account. */
+		static size_t getQueueDepth(const Account& account);
+
+		/** Split a body in parts not larger than max_length bytes,
+		 * preferably on line ends, and never inside an UTF-8
+		 * character.
+		 */
+		static vector<string> split(const string& text, size_t max_length);
+	};
+
+}; /* namespace im */
+
+#endif /* IM_SEND_SCHEDULER_H */
@@ -67,6 +67,14 @@ Buddy::~Buddy()
 		im_buddy.setNick(NULL);
 }
 
+bool Buddy::setState(const State& state)
+{
+	if(state == last_state)
+		return false;
+	last_state = state;
+	return true;
+}
+
 void Buddy::send(Message m)
 {
 	if(m.getCommand() == MSG_PRIVMSG)
@@ -150,6 +158,14 @@ bool Buddy::process_dcc_get(const string& text)
 	uint16_t port;
 	ssize_t size;
 
+	if(DCCGet::parseDCCACCEPT(text, &filename, &port, &size))
+	{
+		RemoteServer* rm = dynamic_cast<RemoteServer*>(getServer());
+		if(rm && !rm->getIRC()->acceptDCCResume(this, port, size))
+			b_log[W_WARNING] << "There isn't any transfer to resume on port " << port;
+		return true;
+	}
+
 	if(DCCGet::parseDCCSEND(text, &filename, &addr, &port, &size))
 	{
 		RemoteServer* rm = dynamic_cast<RemoteServer*>(getServer());
@@ -165,7 +181,7 @@ bool Buddy::process_dcc_get(const string& text)
 		try
 		{
 			filename = path + "/" + filename;
-			rm->getIRC()->createDCCGet(this, filename, addr, port, size, new CallBack<Buddy>(this, &Buddy::received_file, strdup(filename.c_str())));
+			rm->getIRC()->createDCCGet(this, filename, addr, port, size, new CallBack<Buddy>(this, &Buddy::received_file, strdup(filename.c_str())), true);
 
 		}
 		catch(const DCCGetError&)
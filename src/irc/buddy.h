@@ -28,7 +28,31 @@ namespace irc
 	/** This class represents a buddy on IRC */
 	class Buddy : public ConvNick
 	{
+	public:
+
+		/** What IRC users can see about a buddy. */
+		struct State
+		{
+			bool online;
+			bool voice;
+			bool away;
+			string nickname;
+			string realname;
+			string status;       /**< status message, even when away */
+
+			State() : online(false), voice(false), away(false) {}
+			bool operator==(const State& s) const
+			{
+				return online == s.online && voice == s.voice && away == s.away &&
+				       nickname == s.nickname && realname == s.realname &&
+				       status == s.status;
+			}
+			bool operator!=(const State& s) const { return !(*this == s); }
+		};
+
+	private:
 		im::Buddy im_buddy;
+		State last_state;
 		bool public_msgs;
 		time_t public_msgs_last;
 		static const int PUBLIC_MSGS_TIMEOUT = 3600;
@@ -69,6 +93,12 @@ namespace irc
 
 		im::Buddy getBuddy() const { return im_buddy; }
 
+		/** Store the state last published to IRC.
+		 *
+		 * @return  false if it has not changed.
+		 */
+		bool setState(const State& state);
+
 		virtual int sendCommand(const string& cmd);
 
 		/** Get icon in an coloured ASCII-art form. */
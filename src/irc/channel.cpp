@@ -106,7 +106,8 @@ Message ChanUser::getModeMessage(bool add, int modes) const
 
 Channel::Channel(IRC* _irc, string name)
 	: Entity(name),
-	  irc(_irc)
+	  irc(_irc),
+	  who_cache_key(-1)
 {}
 
 Channel::~Channel()
@@ -133,28 +134,50 @@ void Channel::sendNames(Nick* nick) const
 		// user list.
 		// See Message::format()
 		names += " ";
+
+		/* Do not exceed the IRC line length. */
+		if(names.size() > NAMES_LINE_LENGTH)
+		{
+			nick->send(Message(RPL_NAMREPLY).setSender(irc)
+					           .setReceiver(nick)
+						   .addArg("=")
+						   .addArg(getName())
+						   .addArg(names));
+			names.clear();
+		}
 	}
 
-	nick->send(Message(RPL_NAMREPLY).setSender(irc)
-			           .setReceiver(nick)
-				   .addArg("=")
-				   .addArg(getName())
-				   .addArg(names));
+	if(!names.empty() || users.empty())
+		nick->send(Message(RPL_NAMREPLY).setSender(irc)
+				           .setReceiver(nick)
+					   .addArg("=")
+					   .addArg(getName())
+					   .addArg(names));
 	nick->send(Message(RPL_ENDOFNAMES).setSender(irc)
 			           .setReceiver(nick)
 				   .addArg(getName())
 				   .addArg("End of /NAMES list"));
 }
 
+bool Channel::isLocalNick(const Nick* nick) const
+{
+	return nick->getServer() == irc;
+}
+
 ChanUser* Channel::addUser(Nick* nick, int status)
 {
 	ChanUser* chanuser = new ChanUser(this, nick, status);
 	users.push_back(chanuser);
+	invalidateWhoCache();
 
-	string names;
+	/* IM users don't care about JOINs, only local ones are notified. */
+	Message join = Message(MSG_JOIN).setSender(nick).setReceiver(this);
 	for(vector<ChanUser*>::iterator it = users.begin(); it != users.end(); ++it)
 	{
-		(*it)->getNick()->send(Message(MSG_JOIN).setSender(nick).setReceiver(this));
+		if(!isLocalNick((*it)->getNick()))
+			continue;
+
+		(*it)->getNick()->send(join);
 		if(status && (*it)->getNick() != nick)
 		{
 			Message m = chanuser->getModeMessage(true);
@@ -163,6 +186,10 @@ ChanUser* Channel::addUser(Nick* nick, int status)
 			(*it)->getNick()->send(m);
 		}
 	}
+
+	if(!isLocalNick(nick))
+		return chanuser;
+
 	string topic = getTopic();
 	if(!topic.empty())
 		nick->send(Message(RPL_TOPIC).setSender(irc)
@@ -174,8 +201,39 @@ ChanUser* Channel::addUser(Nick* nick, int status)
 	return chanuser;
 }
 
+void Channel::addUsers(const vector<std::pair<Nick*, int> >& nicks)
+{
+	vector<ChanUser*> added;
+	for(vector<std::pair<Nick*, int> >::const_iterator it = nicks.begin(); it != nicks.end(); ++it)
+	{
+		if(it->first->isOn(this))
+			continue;
+		ChanUser* chanuser = new ChanUser(this, it->first, it->second);
+		users.push_back(chanuser);
+		it->first->addChanUser(chanuser);
+		added.push_back(chanuser);
+	}
+
+	if(added.empty())
+		return;
+
+	invalidateWhoCache();
+
+	for(vector<ChanUser*>::iterator it = users.begin(); it != users.end(); ++it)
+	{
+		Nick* member = (*it)->getNick();
+		if(!isLocalNick(member))
+			continue;
+
+		FOREACH(vector<ChanUser*>, added, cu)
+			member->send(Message(MSG_JOIN).setSender((*cu)->getNick()).setReceiver(this));
+		sendNames(member);
+	}
+}
+
 void Channel::delUser(Nick* nick, Message m)
 {
+	invalidateWhoCache();
 	for(vector<ChanUser*>::iterator it = users.begin(); it != users.end(); )
 		if((*it)->getNick() == nick)
 		{
@@ -190,6 +248,42 @@ void Channel::delUser(Nick* nick, Message m)
 		}
 }
 
+void Channel::delUsers(const set<Nick*>& nicks)
+{
+	invalidateWhoCache();
+	vector<ChanUser*> kept;
+	kept.reserve(users.size());
+	FOREACH(vector<ChanUser*>, users, it)
+		if(nicks.find((*it)->getNick()) != nicks.end())
+		{
+			(*it)->getNick()->removeChanUser(*it);
+			delete *it;
+		}
+		else
+			kept.push_back(*it);
+	users.swap(kept);
+}
+
+bool Channel::getWhoCache(int key, vector<WhoEntry>& entries) const
+{
+	if(who_cache_key < 0 || who_cache_key != key)
+		return false;
+	entries = who_cache;
+	return true;
+}
+
+void Channel::setWhoCache(int key, const vector<WhoEntry>& entries)
+{
+	who_cache = entries;
+	who_cache_key = key;
+}
+
+void Channel::invalidateWhoCache()
+{
+	who_cache.clear();
+	who_cache_key = -1;
+}
+
 ChanUser* Channel::getChanUser(string nick) const
 {
 	/* Match is case sensitive */
@@ -21,6 +21,7 @@
 
 #include <string>
 #include <vector>
+#include <set>
 
 #include "message.h"
 #include "core/entity.h"
@@ -29,6 +30,7 @@
 namespace irc
 {
 	using std::vector;
+	using std::set;
 	using std::string;
 
 
@@ -36,6 +38,18 @@ namespace irc
 	class IRC;
 	class Channel;
 
+	/** Fields of a WHO reply line, cached by channels. */
+	struct WhoEntry
+	{
+		string channame;
+		string identname;
+		string hostname;
+		string servername;
+		string nickname;
+		string info;
+		bool away;
+	};
+
 	/** This class represents a channel user. */
 	class ChanUser : public Entity
 	{
@@ -106,9 +120,17 @@ namespace irc
 	protected:
 		IRC* irc;
 
+		/** Nicks on the minbif server itself, which are the only
+		 * ones to care about JOINs, MODEs and NAMES. */
+		bool isLocalNick(const Nick* nick) const;
+
 	private:
 		vector<ChanUser*> users;
 		string topic;
+		vector<WhoEntry> who_cache;
+		int who_cache_key;
+
+		static const size_t NAMES_LINE_LENGTH = 400;
 
 	public:
 
@@ -147,6 +169,16 @@ namespace irc
 		 */
 		ChanUser* addUser(Nick* nick, int status=0);
 
+		/** Add several nicks on channel at once.
+		 *
+		 * Only local users (see isLocalNick()) are notified. They get one
+		 * JOIN per new nick but no MODE message, and then a single
+		 * NAMES reply which already contains prefixes.
+		 *
+		 * @param nicks  nicks to add, with their initial status.
+		 */
+		void addUsers(const vector<std::pair<Nick*, int> >& nicks);
+
 		/** Remove an user from channel.
 		 *
 		 * @param nick  user to remove
@@ -154,6 +186,15 @@ namespace irc
 		 */
 		virtual void delUser(Nick* nick, Message message = Message());
 
+		/** Remove several users from channel in one pass.
+		 *
+		 * Nothing is sent to other channel users, caller has to
+		 * notify them itself (see IRC::removeServer()).
+		 *
+		 * @param nicks  users to remove
+		 */
+		virtual void delUsers(const set<Nick*>& nicks);
+
 		/** Count users on channel. */
 		size_t countUsers() const { return users.size(); }
 
@@ -163,6 +204,21 @@ namespace irc
 		/** Get a channel user. */
 		virtual ChanUser* getChanUser(string nick) const;
 
+		/** Get cached WHO reply lines.
+		 *
+		 * @param key  WHO flags the cache has to be built with
+		 * @param entries  filled with cached lines
+		 * @return  false if there isn't any valid cache for this key
+		 */
+		bool getWhoCache(int key, vector<WhoEntry>& entries) const;
+
+		/** Store WHO reply lines, until a member changes. */
+		void setWhoCache(int key, const vector<WhoEntry>& entries);
+
+		/** Called when a member joins, leaves, or changes its nickname,
+		 * away state or realname. */
+		void invalidateWhoCache();
+
 		/** Get topic */
 		virtual string getTopic() const { return topic; }
 
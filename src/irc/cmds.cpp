@@ -22,6 +22,9 @@
 #include "irc/irc.h"
 #include "irc/user.h"
 #include "irc/channel.h"
+#include "irc/dcc.h"
+#include "irc/transfer_manager.h"
+#include "im/login_scheduler.h"
 #include "server_poll/poll.h"
 #include "core/version.h"
 #include "core/util.h"
@@ -374,6 +377,49 @@ void IRC::m_stats(Message message)
 			}
 			break;
 		}
+		case 'f':
+		{
+			size_t user_rate = transfers->getUserRate();
+			size_t global_rate = transfers->getGlobalRate();
+			notice(user, "Bandwidth limit: " +
+			             (user_rate ? t2s(user_rate / 1024) + " KB/s" : string("none")) + " for you, " +
+			             (global_rate ? t2s(global_rate / 1024) + " KB/s shared by " + t2s(transfers->getShares()) + " user(s)"
+			                          : string("none")) + " globally");
+			notice(user, "Current rate: " + t2s((unsigned)(transfers->getTotalRate() / 1024)) + " KB/s");
+
+			const vector<DCC*>& dccs = transfers->getDCCs();
+			for(vector<DCC*>::const_iterator it = dccs.begin(); it != dccs.end(); ++it)
+			{
+				DCC* dcc = *it;
+				if(dcc->isFinished())
+					continue;
+
+				double rate = transfers->getRate(dcc);
+				size_t done = dcc->getBytesTransferred(), total = dcc->getTotalSize();
+				string eta = "unknown";
+				if(rate > 0 && total > done)
+				{
+					unsigned left = (unsigned)((total - done) / rate);
+					gchar *s = g_strdup_printf("%d:%02d:%02d", left / 3600, (left / 60) % 60, left % 60);
+					eta = s;
+					g_free(s);
+				}
+
+				notice(user, dcc->getType() + " " + dcc->getFileName() +
+				             " (" + (dcc->getPeer() ? dcc->getPeer()->getNickname() : string("*")) + "): " +
+				             t2s(done / 1024) + "/" + t2s(total / 1024) + " KB, " +
+				             t2s((unsigned)(rate / 1024)) + " KB/s, ETA " + eta + ", " +
+				             t2s(dcc->getBytesInFlight() / 1024) + " KB in flight");
+			}
+			break;
+		}
+		case 'l':
+			notice(user, "Login queue depth: " + t2s(im::LoginScheduler::getQueueDepth()));
+			notice(user, "Connecting accounts: " + t2s(im::LoginScheduler::countConnecting()));
+			notice(user, "Established connections: " + t2s(im::LoginScheduler::countConnects()));
+			notice(user, "Connect latency: " + t2s(im::LoginScheduler::getLastLatency()) + " ms (average " +
+			             t2s(im::LoginScheduler::getAverageLatency()) + " ms)");
+			break;
 		case 'm':
 			for(size_t i = 0; commands[i].cmd != NULL; ++i)
 				user->send(Message(RPL_STATSCOMMANDS).setSender(this)
@@ -488,6 +534,8 @@ void IRC::m_stats(Message message)
 			arg = "*";
 			notice(user, "a (aways) - List all away messages availables");
 			notice(user, "c (chat params) - List all chat parameters for a specific account");
+			notice(user, "f (file transfers) - Display DCC transfers and bandwidth usage");
+			notice(user, "l (logins) - Display login queue and connect latency");
 			notice(user, "m (commands) - List all IRC commands");
 			notice(user, "o (opers) - List all opers accounts");
 			notice(user, "p (protocols) - List all protocols");
@@ -17,17 +17,32 @@
  */
 
 #include <cstring>
-#include <fnmatch.h>
 
 #include "core/caca_image.h"
+#include "core/caca_renderer.h"
 #include "irc/irc.h"
 #include "irc/user.h"
 #include "irc/buddy.h"
 #include "irc/channel.h"
+#include "irc/mask.h"
+#include "im/roomlist.h"
 
 namespace irc {
 
-/** WHO */
+static WhoEntry who_entry(Nick* n, const string& channame, bool status)
+{
+	WhoEntry entry;
+	entry.channame = channame;
+	entry.identname = n->getIdentname();
+	entry.hostname = n->getHostname();
+	entry.servername = n->getServer()->getServerName();
+	entry.nickname = n->getNickname();
+	entry.away = n->isAway();
+	entry.info = status ? n->getStatusMessage(true) : n->getRealName();
+	return entry;
+}
+
+/** WHO [mask] [+-s] [%fields[,token]] */
 void IRC::m_who(Message message)
 {
 	string arg;
@@ -38,6 +53,8 @@ void IRC::m_who(Message message)
 	};
 #define fset(v, b, f) v = b ? v|f : v&(~f)
 	int flags = 0;
+	bool whox = false;
+	string whox_fields, whox_token = "0";
 
 	if(message.countArgs() > 0)
 	{
@@ -45,6 +62,19 @@ void IRC::m_who(Message message)
 		for(vector<string>::iterator it = args.begin(); it != args.end(); ++it)
 		{
 			bool add = true;
+			if (it->find('%') != string::npos)
+			{
+				/* WHOX: [flags]%fields[,token] */
+				whox = true;
+				whox_fields = it->substr(it->find('%') + 1);
+				size_t comma = whox_fields.find(',');
+				if (comma != string::npos)
+				{
+					whox_token = whox_fields.substr(comma + 1);
+					whox_fields = whox_fields.substr(0, comma);
+				}
+				continue;
+			}
 			if (!strchr("+-", (*it)[0]))
 			{
 				arg = *it;
@@ -68,37 +98,100 @@ void IRC::m_who(Message message)
 #undef fset
 
 	if(arg.empty() || !Channel::isChanName(arg) || (chan = getChannel(arg)))
-		for(std::map<string, Nick*>::iterator it = users.begin(); it != users.end(); ++it)
+	{
+		vector<WhoEntry> entries;
+
+		if(chan)
 		{
-			Nick* n = it->second;
-			string channame = "*";
-			if(arg.empty() || arg == "*" || arg == "0" || n->getServer()->getServerName().find(arg) != string::npos ||
-			   !fnmatch(arg.c_str(), n->getNickname().c_str(), FNM_NOESCAPE|FNM_CASEFOLD))
+			if(!chan->getWhoCache(flags, entries))
 			{
-				vector<ChanUser*> chans = n->getChannels();
-				if(!chans.empty())
-					channame = chans.front()->getChannel()->getName();
+				/* Sorted by nickname, as users are. */
+				std::map<string, Nick*> found;
+				vector<ChanUser*> chanusers = chan->getChanUsers();
+				FOREACH(vector<ChanUser*>, chanusers, cu)
+					found[(*cu)->getNick()->getNickname()] = (*cu)->getNick();
+				for(std::map<string, Nick*>::iterator it = found.begin(); it != found.end(); ++it)
+					entries.push_back(who_entry(it->second, arg, flags & WHO_STATUS));
+				chan->setWhoCache(flags, entries);
 			}
-			else if(chan)
+		}
+		else
+		{
+			std::map<string, Nick*> found;
+
+			if(arg.empty() || arg == "*" || arg == "0")
+				found = users;
+			else
 			{
-				if(!n->isOn(chan))
-					continue;
-				channame = arg;
+				vector<Server*> matched_servers;
+				if(getServerName().find(arg) != string::npos)
+					matched_servers.push_back(this);
+				for(std::map<string, Server*>::iterator s = servers.begin(); s != servers.end(); ++s)
+					if(s->second->getServerName().find(arg) != string::npos)
+						matched_servers.push_back(s->second);
+				FOREACH(vector<Server*>, matched_servers, s)
+				{
+					set<Nick*> nicks = (*s)->getNicks();
+					FOREACH(set<Nick*>, nicks, n)
+						found[(*n)->getNickname()] = *n;
+				}
+
+				vector<Nick*> nicks = matchNick(Mask(arg));
+				FOREACH(vector<Nick*>, nicks, n)
+					found[(*n)->getNickname()] = *n;
 			}
-			else
+
+			for(std::map<string, Nick*>::iterator it = found.begin(); it != found.end(); ++it)
+			{
+				vector<ChanUser*> chans = it->second->getChannels();
+				string channame = chans.empty() ? "*" : chans.front()->getChannel()->getName();
+				entries.push_back(who_entry(it->second, channame, flags & WHO_STATUS));
+			}
+		}
+
+		FOREACH(vector<WhoEntry>, entries, e)
+		{
+			if(!whox)
+			{
+				user->send(Message(RPL_WHOREPLY).setSender(this)
+								.setReceiver(user)
+								.addArg(e->channame)
+								.addArg(e->identname)
+								.addArg(e->hostname)
+								.addArg(e->servername)
+								.addArg(e->nickname)
+								.addArg(e->away ? "G" : "H")
+								.addArg("0 " + e->info));
 				continue;
+			}
 
-			user->send(Message(RPL_WHOREPLY).setSender(this)
-							.setReceiver(user)
-							.addArg(channame)
-							.addArg(n->getIdentname())
-							.addArg(n->getHostname())
-							.addArg(n->getServer()->getServerName())
-							.addArg(n->getNickname())
-							.addArg(n->isAway() ? "G" : "H")
-							.addArg("0 " + (flags & WHO_STATUS ? n->getStatusMessage(true)
-							                                   : n->getRealName())));
+			/* WHOX fields are always sent in this order. */
+			Message m = Message(RPL_WHOSPCRPL).setSender(this)
+							  .setReceiver(user);
+			for(const char* f = "tcuihsnfdlaor"; *f; ++f)
+			{
+				if(whox_fields.find(*f) == string::npos)
+					continue;
+				switch(*f)
+				{
+					case 't': m.addArg(whox_token); break;
+					case 'c': m.addArg(e->channame); break;
+					case 'u': m.addArg(e->identname); break;
+					case 'i': m.addArg("255.255.255.255"); break;
+					case 'h': m.addArg(e->hostname); break;
+					case 's': m.addArg(e->servername); break;
+					case 'n': m.addArg(e->nickname); break;
+					case 'f': m.addArg(e->away ? "G" : "H"); break;
+					case 'd': m.addArg("0"); break;
+					case 'l': m.addArg("0"); break;
+					case 'a': m.addArg("0"); break;
+					case 'o': m.addArg("n/a"); break;
+					case 'r': m.addArg(e->info.empty() ? " " : e->info); break;
+				}
+			}
+			user->send(m);
 		}
+	}
 	user->send(Message(RPL_ENDOFWHO).setSender(this)
 					.setReceiver(user)
 					.addArg(!arg.empty() ? arg : "**")
@@ -106,6 +199,66 @@ void IRC::m_who(Message message)
 }
 
 /** WHOIS nick */
+void IRC::sendWhoisIcon(const string& nickname, string buf)
+{
+	string line;
+	user->send(Message(RPL_WHOISACTUALLY).setSender(this)
+				       .setReceiver(user)
+				       .addArg(nickname)
+				       .addArg("Icon:"));
+	while((line = stringtok(buf, "\r\n")).empty() == false)
+	{
+		user->send(Message(RPL_WHOISACTUALLY).setSender(this)
+					       .setReceiver(user)
+					       .addArg(nickname)
+					       .addArg(line));
+	}
+}
+
+bool IRC::whoisIconRendered(void* data)
+{
+	CacaRenderer::Job* job = static_cast<CacaRenderer::Job*>(data);
+	if(job->hasFailed())
+		user->send(Message(RPL_WHOISACTUALLY).setSender(this)
+					       .setReceiver(user)
+					       .addArg(job->getTag())
+					       .addArg("No icon"));
+	else
+		sendWhoisIcon(job->getTag(), job->getBuffer());
+
+	endWhois(job->getTag(), GPOINTER_TO_INT(job->getData()));
+	return true;
+}
+
+void IRC::endWhois(const string& nickname, bool extended_whois)
+{
+	/* The buddy may have left while its icon was rendered. */
+	Nick* n = getNick(nickname);
+	if(n)
+	{
+		string url = conf.GetSection("irc")->GetItem("buddy_icons_url")->String();
+		string icon_path = n->getIconPath();
+		if(url != " " && !icon_path.empty())
+		{
+			icon_path = icon_path.substr(im->getUserPath().size());
+			user->send(Message(RPL_WHOISACTUALLY).setSender(this)
+							       .setReceiver(user)
+							       .addArg(n->getNickname())
+							       .addArg("Icon URL: " + url + im->getUsername() + icon_path));
+		}
+	}
+
+	/* Retrieve server info about this buddy only if this is an extended
+	 * whois. In this case, do not send a ENDOFWHOIS because this
+	 * is an asynchronous call.
+	 */
+	if(!n || !extended_whois || !n->retrieveInfo())
+		user->send(Message(RPL_ENDOFWHOIS).setSender(this)
+						  .setReceiver(user)
+						  .addArg(n ? n->getNickname() : nickname)
+						  .addArg("End of /WHOIS list"));
+}
+
 void IRC::m_whois(Message message)
 {
 	Nick* n = getNick(message.getArg(0));
@@ -167,20 +320,21 @@ void IRC::m_whois(Message message)
 
 
 	CacaImage icon = n->getIcon();
+	unsigned icon_height = extended_whois ? 15 : 10;
 	try
 	{
-		string buf = icon.getIRCBuffer(0, extended_whois ? 15 : 10);
-		string line;
-		user->send(Message(RPL_WHOISACTUALLY).setSender(this)
-					       .setReceiver(user)
-					       .addArg(n->getNickname())
-					       .addArg("Icon:"));
-		while((line = stringtok(buf, "\r\n")).empty() == false)
+		if(!icon.isValid())
+			throw CacaError();
+
+		/* Rendering an icon is long, so a new one is sent when it
+		 * is ready, followed by the end of the reply. */
+		if(icon.getCachedBuffer(0, icon_height))
+			sendWhoisIcon(n->getNickname(), icon.getIRCBuffer(0, icon_height));
+		else
 		{
-			user->send(Message(RPL_WHOISACTUALLY).setSender(this)
-						       .setReceiver(user)
-						       .addArg(n->getNickname())
-						       .addArg(line));
+			CacaRenderer::render(icon, 0, icon_height, "irc", this, &IRC::whoisIconRendered,
+			                     GINT_TO_POINTER(extended_whois), n->getNickname());
+			return;
 		}
 	}
 	catch(CacaError &e)
@@ -197,27 +351,8 @@ void IRC::m_whois(Message message)
 					       .addArg(n->getNickname())
 					       .addArg("libcaca and imlib2 are required to display icon"));
 	}
-	string url = conf.GetSection("irc")->GetItem("buddy_icons_url")->String();
-	string icon_path = n->getIconPath();
-	if(url != " " && !icon_path.empty())
-	{
-		icon_path = icon_path.substr(im->getUserPath().size());
-		user->send(Message(RPL_WHOISACTUALLY).setSender(this)
-						       .setReceiver(user)
-						       .addArg(n->getNickname())
-						       .addArg("Icon URL: " + url + im->getUsername() + icon_path));
-	}
-
-	/* Retrieve server info about this buddy only if this is an extended
-	 * whois. In this case, do not send a ENDOFWHOIS because this
-	 * is an asynchronous call.
-	 */
-	if(!extended_whois || !n->retrieveInfo())
-		user->send(Message(RPL_ENDOFWHOIS).setSender(this)
-						  .setReceiver(user)
-						  .addArg(n->getNickname())
-						  .addArg("End of /WHOIS list"));
 
+	endWhois(n->getNickname(), extended_whois);
 }
 
 /** WHOWAS nick
@@ -413,17 +548,20 @@ void IRC::m_part(Message message)
 /** LIST */
 void IRC::m_list(Message message)
 {
-	if(message.countArgs() == 0)
+	if(message.countArgs() == 0 || im::RoomList::Filter::isFilter(message.getArg(0)))
 	{
+		im::RoomList::Filter filter(message.countArgs() > 0 ? message.getArg(0) : "");
+
 		user->send(Message(RPL_LISTSTART).setSender(this)
 						 .setReceiver(user)
 						 .addArg("Channel")
 						 .addArg("Users  Name"));
 		for(map<string, Channel*>::iterator it = channels.begin(); it != channels.end(); ++it)
-			user->send(Message(RPL_LIST).setSender(this)
-						    .setReceiver(user)
-						    .addArg(it->second->getName())
-						    .addArg(t2s(it->second->countUsers())));
+			if(filter.match(it->second->getName(), (int)it->second->countUsers()))
+				user->send(Message(RPL_LIST).setSender(this)
+							    .setReceiver(user)
+							    .addArg(it->second->getName())
+							    .addArg(t2s(it->second->countUsers())));
 
 		user->send(Message(RPL_LISTEND).setSender(this)
 					       .setReceiver(user)
@@ -437,7 +575,18 @@ void IRC::m_list(Message message)
 						       .setReceiver(user)
 						       .addArg("End of /LIST"));
 		else
-			account.displayRoomList();
+		{
+			/* LIST account [filter] [-f] */
+			string filter;
+			bool refresh = false;
+			for(size_t i = 1; i < message.countArgs(); ++i)
+				if(message.getArg(i) == "-f")
+					refresh = true;
+				else
+					filter = message.getArg(i);
+
+			account.displayRoomList(filter, refresh);
+		}
 	}
 }
 
@@ -464,6 +613,257 @@ void IRC::m_ison(Message message)
 				    .addArg(list));
 }
 
+unsigned IRC::countMonitors(int flag) const
+{
+	unsigned count = 0;
+	for(map<string, int>::const_iterator it = monitors.begin(); it != monitors.end(); ++it)
+		if(it->second & flag)
+			count++;
+	return count;
+}
+
+void IRC::updateMonitor(const string& nickname)
+{
+	map<string, int>::iterator it = monitors.find(strlower(nickname));
+	if(it == monitors.end())
+		return;
+
+	Nick* n = getNick(nickname);
+	bool online = n && n->isOnline();
+	if(online == !!(it->second & MONITOR_ONLINE))
+		return;
+
+	it->second ^= MONITOR_ONLINE;
+	if(it->second & MONITOR_CMD)
+		sendMonitorStatus(nickname, MONITOR_CMD);
+	if(it->second & MONITOR_WATCH)
+	{
+		user->send(Message(online ? RPL_LOGON : RPL_LOGOFF).setSender(this)
+								  .setReceiver(user)
+								  .addArg(n ? n->getNickname() : nickname)
+								  .addArg(n ? n->getIdentname() : "*")
+								  .addArg(n ? n->getHostname() : "*")
+								  .addArg(t2s(time(NULL)))
+								  .addArg(online ? "logged online" : "logged offline"));
+	}
+}
+
+void IRC::sendMonitorStatus(const string& nickname, int flags)
+{
+	Nick* n = getNick(nickname);
+	bool online = n && n->isOnline();
+
+	if(flags & MONITOR_CMD)
+	{
+		if(online)
+			user->send(Message(RPL_MONONLINE).setSender(this)
+							 .setReceiver(user)
+							 .addArg(n->getLongName()));
+		else
+			user->send(Message(RPL_MONOFFLINE).setSender(this)
+							  .setReceiver(user)
+							  .addArg(nickname));
+	}
+	if(flags & MONITOR_WATCH)
+	{
+		user->send(Message(online ? RPL_NOWON : RPL_NOWOFF).setSender(this)
+								  .setReceiver(user)
+								  .addArg(online ? n->getNickname() : nickname)
+								  .addArg(online ? n->getIdentname() : "*")
+								  .addArg(online ? n->getHostname() : "*")
+								  .addArg("0")
+								  .addArg(online ? "is online" : "is offline"));
+	}
+}
+
+/** MONITOR {+|-} nick[,nick...]
+ *  MONITOR {C|L|S}
+ */
+void IRC::m_monitor(Message message)
+{
+	string cmd = message.getArg(0);
+	string targets = message.countArgs() > 1 ? message.getArg(1) : "";
+	string nick;
+
+	switch(cmd.empty() ? 0 : cmd[0])
+	{
+		case '+':
+			while((nick = stringtok(targets, ",")).empty() == false)
+			{
+				string key = strlower(nick);
+				map<string, int>::iterator it = monitors.find(key);
+				if(it == monitors.end() || !(it->second & MONITOR_CMD))
+				{
+					if(countMonitors(MONITOR_CMD) >= MONITOR_LIMIT)
+					{
+						user->send(Message(ERR_MONLISTFULL).setSender(this)
+										   .setReceiver(user)
+										   .addArg(t2s((unsigned)MONITOR_LIMIT))
+										   .addArg(targets.empty() ? nick : nick + "," + targets)
+										   .addArg("Monitor list is full."));
+						break;
+					}
+					Nick* n = getNick(nick);
+					monitors[key] |= MONITOR_CMD;
+					if(n && n->isOnline())
+						monitors[key] |= MONITOR_ONLINE;
+					else
+						monitors[key] &= ~MONITOR_ONLINE;
+				}
+				sendMonitorStatus(nick, MONITOR_CMD);
+			}
+			break;
+		case '-':
+			while((nick = stringtok(targets, ",")).empty() == false)
+			{
+				map<string, int>::iterator it = monitors.find(strlower(nick));
+				if(it == monitors.end())
+					continue;
+				it->second &= ~MONITOR_CMD;
+				if(!(it->second & MONITOR_WATCH))
+					monitors.erase(it);
+			}
+			break;
+		case 'C':
+		case 'c':
+			for(map<string, int>::iterator it = monitors.begin(); it != monitors.end();)
+			{
+				it->second &= ~MONITOR_CMD;
+				if(!(it->second & MONITOR_WATCH))
+					monitors.erase(it++);
+				else
+					++it;
+			}
+			break;
+		case 'L':
+		case 'l':
+			for(map<string, int>::iterator it = monitors.begin(); it != monitors.end(); ++it)
+				if(it->second & MONITOR_CMD)
+					user->send(Message(RPL_MONLIST).setSender(this)
+								       .setReceiver(user)
+								       .addArg(it->first));
+			user->send(Message(RPL_ENDOFMONLIST).setSender(this)
+							    .setReceiver(user)
+							    .addArg("End of MONITOR list"));
+			break;
+		case 'S':
+		case 's':
+			for(map<string, int>::iterator it = monitors.begin(); it != monitors.end(); ++it)
+				if(it->second & MONITOR_CMD)
+					sendMonitorStatus(it->first, MONITOR_CMD);
+			break;
+		default:
+			user->send(Message(ERR_UNKNOWNCOMMAND).setSender(this)
+							      .setReceiver(user)
+							      .addArg(MSG_MONITOR)
+							      .addArg("Unknown MONITOR subcommand"));
+			break;
+	}
+}
+
+/** WATCH [+nick|-nick|C|L|S]... */
+void IRC::m_watch(Message message)
+{
+	vector<string> args = message.getArgs();
+	if(args.empty())
+		args.push_back("l");
+
+	FOREACH(vector<string>, args, arg)
+	{
+		if(arg->empty())
+			continue;
+
+		string nick = arg->substr(1);
+		switch((*arg)[0])
+		{
+			case '+':
+			{
+				if(nick.empty())
+					break;
+				string key = strlower(nick);
+				map<string, int>::iterator it = monitors.find(key);
+				if(it == monitors.end() || !(it->second & MONITOR_WATCH))
+				{
+					if(countMonitors(MONITOR_WATCH) >= MONITOR_LIMIT)
+					{
+						user->send(Message(ERR_TOOMANYWATCH).setSender(this)
+										    .setReceiver(user)
+										    .addArg(nick)
+										    .addArg("Maximum size for WATCH-list is " + t2s((unsigned)MONITOR_LIMIT) + " entries"));
+						break;
+					}
+					Nick* n = getNick(nick);
+					monitors[key] |= MONITOR_WATCH;
+					if(n && n->isOnline())
+						monitors[key] |= MONITOR_ONLINE;
+					else
+						monitors[key] &= ~MONITOR_ONLINE;
+				}
+				sendMonitorStatus(nick, MONITOR_WATCH);
+				break;
+			}
+			case '-':
+			{
+				map<string, int>::iterator it = monitors.find(strlower(nick));
+				if(it != monitors.end())
+				{
+					it->second &= ~MONITOR_WATCH;
+					if(!(it->second & MONITOR_CMD))
+						monitors.erase(it);
+				}
+				user->send(Message(RPL_WATCHOFF).setSender(this)
+								.setReceiver(user)
+								.addArg(nick)
+								.addArg("*")
+								.addArg("*")
+								.addArg("0")
+								.addArg("stopped watching"));
+				break;
+			}
+			case 'C':
+			case 'c':
+				for(map<string, int>::iterator it = monitors.begin(); it != monitors.end();)
+				{
+					it->second &= ~MONITOR_WATCH;
+					if(!(it->second & MONITOR_CMD))
+						monitors.erase(it++);
+					else
+						++it;
+				}
+				break;
+			case 'L':
+			case 'l':
+			case 'S':
+			case 's':
+			{
+				/* 'l' only lists online nicks. */
+				string list;
+				for(map<string, int>::iterator it = monitors.begin(); it != monitors.end(); ++it)
+				{
+					if(!(it->second & MONITOR_WATCH))
+						continue;
+					if((*arg)[0] == 'S' || (*arg)[0] == 's')
+					{
+						if(!list.empty())
+							list += " ";
+						list += it->first;
+					}
+					else if((*arg)[0] == 'L' || (it->second & MONITOR_ONLINE))
+						sendMonitorStatus(it->first, MONITOR_WATCH);
+				}
+				if(!list.empty())
+					user->send(Message(RPL_WATCHLIST).setSender(this)
+									 .setReceiver(user)
+									 .addArg(list));
+				user->send(Message(RPL_ENDOFWATCHLIST).setSender(this)
+								      .setReceiver(user)
+								      .addArg("End of WATCH " + arg->substr(0, 1)));
+				break;
+			}
+		}
+	}
+}
+
 /** NAMES chan */
 void IRC::m_names(Message message)
 {
@@ -16,6 +16,7 @@
  */
 
 #include "core/callback.h"
+#include "im/send_scheduler.h"
 #include "irc/nick.h"
 #include "irc/conv_entity.h"
 
@@ -31,13 +32,21 @@ void ConvEntity::enqueueMessage(const string& text, int delay)
 {
 	if (!delay)
 	{
-		conv.sendMessage(text);
+		im::SendScheduler::send(conv, text);
 		return;
 	}
 	enqueued_messages.push_back(text);
 
 	if (enqueued_messages.size() == 1)
-		g_timeout_add(delay, g_callback_delete, new CallBack<ConvEntity>(this, &ConvEntity::flush_messages, NULL));
+	{
+		/* When messages are already waiting for the account's rate
+		 * limit, wait longer to join more lines in one message. */
+		size_t depth = conv.isValid() ? im::SendScheduler::getQueueDepth(conv.getAccount()) : 0;
+		if (depth > MAX_COALESCE_FACTOR - 1)
+			depth = MAX_COALESCE_FACTOR - 1;
+
+		g_timeout_add(delay * (1 + depth), g_callback_delete, new CallBack<ConvEntity>(this, &ConvEntity::flush_messages, NULL));
+	}
 }
 
 bool ConvEntity::flush_messages(void*)
@@ -51,10 +60,10 @@ bool ConvEntity::flush_messages(void*)
 		{
 			if (!buf.empty())
 			{
-				conv.sendMessage(buf);
+				im::SendScheduler::send(conv, buf);
 				buf.clear();
 			}
-			conv.sendMessage(*s);
+			im::SendScheduler::send(conv, *s);
 		}
 		else
 		{
@@ -64,7 +73,7 @@ bool ConvEntity::flush_messages(void*)
 		}
 	}
 	if (!buf.empty())
-		conv.sendMessage(buf);
+		im::SendScheduler::send(conv, buf);
 	return false;
 }
 
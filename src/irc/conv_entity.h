@@ -30,6 +30,8 @@ namespace irc
 		im::Conversation conv;
 		vector<string> enqueued_messages;
 
+		static const size_t MAX_COALESCE_FACTOR = 8; /**< max multiple of send_delay to join lines */
+
 		bool flush_messages(void* data);
 
 	public:
@@ -90,7 +90,68 @@ void ConversationChannel::addBuddy(im::ChatBuddy cbuddy, int status)
 			cul = it->second;
 	}
 
-	cbuddies[cbuddy] = cul;
+	indexBuddy(cbuddy, cul);
+}
+
+void ConversationChannel::indexBuddy(const im::ChatBuddy& cbuddy, ChanUser* chanuser)
+{
+	Nick* nick = chanuser->getNick();
+	unindexBuddy(nick);
+
+	cbuddy_t ref;
+	ref.cbuddy = cbuddy;
+	ref.name = cbuddy.getName();
+
+	cbuddies[cbuddy] = chanuser;
+	cbuddy_names[ref.name] = chanuser;
+	nick_cbuddies[nick] = ref;
+}
+
+void ConversationChannel::unindexBuddy(Nick* nick)
+{
+	map<Nick*, cbuddy_t>::iterator it = nick_cbuddies.find(nick);
+	if(it == nick_cbuddies.end())
+		return;
+
+	map<im::ChatBuddy, ChanUser*>::iterator cb = cbuddies.find(it->second.cbuddy);
+	if(cb != cbuddies.end() && cb->second->getNick() == nick)
+		cbuddies.erase(cb);
+
+	map<string, ChanUser*>::iterator name = cbuddy_names.find(it->second.name);
+	if(name != cbuddy_names.end() && name->second->getNick() == nick)
+		cbuddy_names.erase(name);
+
+	nick_cbuddies.erase(it);
+}
+
+void ConversationChannel::addBuddies(const vector<im::ChatBuddy>& list)
+{
+	vector<std::pair<Nick*, int> > joins;
+	vector<im::ChatBuddy> added;
+
+	/* User has to be on channel first to receive the JOINs. */
+	for(vector<im::ChatBuddy>::const_iterator cb = list.begin(); cb != list.end(); ++cb)
+		if(cb->isMe())
+			addBuddy(*cb, cb->getChanStatus());
+
+	for(vector<im::ChatBuddy>::const_iterator cb = list.begin(); cb != list.end(); ++cb)
+	{
+		if(cb->isMe() || cbuddies.find(*cb) != cbuddies.end())
+			continue;
+
+		ChatBuddy* n = new ChatBuddy(upserver, *cb);
+		while(irc->getNick(n->getNickname()))
+			n->setNickname(n->getNickname() + "_");
+
+		irc->addNick(n);
+		joins.push_back(std::make_pair((Nick*)n, cb->getChanStatus()));
+		added.push_back(*cb);
+	}
+
+	addUsers(joins);
+
+	for(size_t i = 0; i < added.size(); ++i)
+		indexBuddy(added[i], joins[i].first->getChanUser(this));
 }
 
 void ConversationChannel::updateBuddy(im::ChatBuddy cbuddy)
@@ -99,6 +160,8 @@ void ConversationChannel::updateBuddy(im::ChatBuddy cbuddy)
 	int mlast = chanuser->getStatus();
 	int mnew = cbuddy.getChanStatus();
 	int add = 0, del = 0;
+
+	invalidateWhoCache();
 	for(unsigned i = 0; i < (sizeof i) * 8; ++i)
 	{
 		if(!(mlast & (1 << i)) && mnew & (1 << i))
@@ -126,19 +189,13 @@ void ConversationChannel::renameBuddy(ChanUser* chanuser, im::ChatBuddy cbuddy)
 		irc->renameNick(nick, new_nick);
 	}
 
-	cbuddies.erase(nick->getChatBuddy());
 	nick->setChatBuddy(cbuddy);
-	cbuddies[cbuddy] = chanuser;
+	indexBuddy(cbuddy, chanuser);
 }
 
 void ConversationChannel::delUser(Nick* nick, Message message)
 {
-	map<im::ChatBuddy, ChanUser*>::iterator it;
-	for(it = cbuddies.begin(); it != cbuddies.end() && it->second->getNick() != nick; ++it)
-		;
-
-	if(it != cbuddies.end())
-		cbuddies.erase(it);
+	unindexBuddy(nick);
 
 	Channel::delUser(nick, message);
 
@@ -149,12 +206,24 @@ void ConversationChannel::delUser(Nick* nick, Message message)
 		getConversation().leave();
 }
 
+void ConversationChannel::delUsers(const set<Nick*>& nicks)
+{
+	for(set<Nick*>::const_iterator it = nicks.begin(); it != nicks.end(); ++it)
+		unindexBuddy(*it);
+
+	Channel::delUsers(nicks);
+}
+
 ChanUser* ConversationChannel::getChanUser(string nick) const
 {
-	map<im::ChatBuddy, ChanUser*>::const_iterator it;
+	map<string, ChanUser*>::const_iterator it = cbuddy_names.find(nick);
+	if(it != cbuddy_names.end())
+		return it->second;
+
+	/* Some protocols do not give the exact case of the name. */
 	nick = strlower(nick);
-	for(it = cbuddies.begin(); it != cbuddies.end(); ++it)
-		if(strlower(it->first.getName()) == nick)
+	for(it = cbuddy_names.begin(); it != cbuddy_names.end(); ++it)
+		if(strlower(it->first) == nick)
 			return it->second;
 	return NULL;
 }
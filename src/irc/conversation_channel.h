@@ -35,7 +35,21 @@ namespace irc
 	{
 		RemoteServer* upserver;
 
+		/* Chat buddies are indexed by PurpleConvChatBuddy* (see
+		 * im::ChatBuddy::operator<), by nick and by name. Names are
+		 * case sensitive, as some protocols (XMPP MUCs) allow
+		 * occupants which only differ by case. */
+		struct cbuddy_t
+		{
+			im::ChatBuddy cbuddy;
+			string name;
+		};
 		map<im::ChatBuddy, ChanUser*> cbuddies;
+		map<Nick*, cbuddy_t> nick_cbuddies;
+		map<string, ChanUser*> cbuddy_names;
+
+		void indexBuddy(const im::ChatBuddy& cbuddy, ChanUser* chanuser);
+		void unindexBuddy(Nick* nick);
 
 	public:
 
@@ -54,9 +68,17 @@ namespace irc
 		ChanUser* getChanUser(const im::ChatBuddy& cb) const;
 
 		void addBuddy(im::ChatBuddy cbuddy, int status = 0);
+
+		/** Add a list of chat buddies at once.
+		 *
+		 * Every nick is created and inserted before anything is
+		 * sent, then the user receives a single NAMES reply.
+		 */
+		void addBuddies(const vector<im::ChatBuddy>& cbuddies);
 		void updateBuddy(im::ChatBuddy cbuddy);
 		void renameBuddy(ChanUser* chanuser, im::ChatBuddy cbuddy);
 		virtual void delUser(Nick* nick, Message message = Message());
+		virtual void delUsers(const set<Nick*>& nicks);
 
 		virtual string getTopic() const;
 
@@ -23,11 +23,17 @@
 #include <string.h>
 #include <sys/types.h>
 #include <netinet/in.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#  include <sys/sendfile.h>
+#endif
 
 #include "dcc.h"
 #include "nick.h"
 #include "message.h"
+#include "transfer_manager.h"
 #include "core/callback.h"
 #include "core/util.h"
 #include "core/log.h"
@@ -142,15 +148,29 @@ void DCCServer::listen_cb(int sock, void* data)
 						 "\001"));
 }
 
+static bool dcc_turbo()
+{
+	return conf.GetSection("file_transfers")->GetItem("dcc_turbo")->Boolean();
+}
+
 DCCSend::DCCSend(const im::FileTransfert& _ft, Nick* _sender, Nick* _receiver)
-	: DCCServer("SEND", _ft.getFileName(), _ft.getSize(), _sender, _receiver),
+	: DCCServer(dcc_turbo() ? "TSEND" : "SEND", _ft.getFileName(), _ft.getSize(), _sender, _receiver),
 	  ft(_ft),
 	  local_filename(_ft.getLocalFileName()),
+	  turbo(dcc_turbo()),
+	  window(conf.GetSection("file_transfers")->GetItem("dcc_window")->Integer() * 1024),
+	  pipe(NULL),
+	  file_fd(-1),
+	  write_watcher(0),
+	  eof_sent(false),
 	  bytes_sent(0),
-	  fp(NULL),
-	  rxlen(0),
-	  rxqueue(NULL)
+	  bytes_acked(0),
+	  rxlen(0)
 {
+	first_sent.tv_sec = first_sent.tv_usec = 0;
+
+	if(im::FileTransfert::isStreaming())
+		pipe = ft.openPipe();
 }
 
 DCCSend::~DCCSend()
@@ -160,13 +180,24 @@ DCCSend::~DCCSend()
 
 void DCCSend::deinit()
 {
+	if(write_watcher > 0)
+		purple_input_remove(write_watcher);
+	write_watcher = 0;
+
 	DCCServer::deinit();
 
-	if(fp != NULL)
-		fclose(fp);
-	g_free(rxqueue);
-	fp = NULL;
-	rxqueue = NULL;
+	if(pipe)
+	{
+		if(ft.isValid())
+			ft.closePipe();
+		delete pipe;
+		pipe = NULL;
+	}
+
+	if(file_fd >= 0)
+		close(file_fd);
+	file_fd = -1;
+	rxlen = 0;
 }
 
 void DCCSend::updated(bool destroy)
@@ -180,38 +211,175 @@ void DCCSend::updated(bool destroy)
 		dcc_send();
 }
 
+double DCCSend::getRate() const
+{
+	if(!first_sent.tv_sec)
+		return 0;
+
+	GTimeVal now;
+	g_get_current_time(&now);
+	double elapsed = (now.tv_sec - first_sent.tv_sec) + (now.tv_usec - first_sent.tv_usec) / 1000000.0;
+	return elapsed > 0 ? bytes_sent / elapsed : 0;
+}
+
+void DCCSend::dcc_write_cb(gpointer data, int source, PurpleInputCondition cond)
+{
+	DCCSend* dcc = static_cast<DCCSend*>(data);
+	dcc->dcc_send();
+}
+
+void DCCSend::setWritable(bool wait)
+{
+	if(wait && write_watcher <= 0)
+		write_watcher = purple_input_add(fd, PURPLE_INPUT_WRITE, DCCSend::dcc_write_cb, this);
+	else if(!wait && write_watcher > 0)
+	{
+		purple_input_remove(write_watcher);
+		write_watcher = 0;
+	}
+}
+
 void DCCSend::dcc_send()
 {
-	if(finished || listen_data || fd < 0)
+	if(finished || listen_data || fd < 0 || eof_sent)
 		return;
 
-	if(!fp)
+	size_t limit;
+	if(pipe)
+	{
+		if(pipe->isDetached() && !pipe->size() && total_size && bytes_sent < total_size)
+		{
+			b_log[W_ERR] << "Transfer of " << filename << " has been interrupted";
+			deinit();
+			return;
+		}
+		limit = bytes_sent + pipe->size();
+	}
+	else
+	{
+		if(file_fd < 0)
+		{
+			file_fd = open(local_filename.c_str(), O_RDONLY);
+			if(file_fd < 0)
+				return; /* File isn't written yet. */
+			fcntl(file_fd, F_SETFD, FD_CLOEXEC);
+		}
+
+		/* libpurple may still be writting the file. */
+		struct stat st;
+		if(fstat(file_fd, &st) < 0)
+		{
+			b_log[W_ERR] << "Unable to read " << local_filename << ": " << strerror(errno);
+			deinit();
+			return;
+		}
+		limit = (size_t)st.st_size;
+	}
+
+	if(total_size && limit > total_size)
+		limit = total_size;
+	if(!turbo && limit > bytes_acked + window)
+		limit = bytes_acked + window;
+	if(manager && limit > bytes_sent)
+		limit = bytes_sent + manager->allowance(this, limit - bytes_sent);
+
+	size_t start = bytes_sent;
+	bool wait = false;
+	while(bytes_sent < limit)
 	{
-		fp = fopen(local_filename.c_str(), "r");
-		if(!fp)
-			return; /* File isn't written yet. */
+		ssize_t len;
+		if(pipe)
+		{
+			len = send(fd, pipe->data(), limit - bytes_sent, 0);
+			if(len > 0)
+				pipe->consume(len);
+		}
+		else
+		{
+#ifdef __linux__
+			off_t offset = (off_t)bytes_sent;
+			len = sendfile(fd, file_fd, &offset, limit - bytes_sent);
+#else
+			static char buf[65536];
+			size_t count = limit - bytes_sent;
+			len = pread(file_fd, buf, count < sizeof buf ? count : sizeof buf, (off_t)bytes_sent);
+			if(len > 0)
+				len = send(fd, buf, len, 0);
+#endif
+		}
+
+		if(len < 0)
+		{
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				wait = true;
+			else if(errno != EINTR)
+			{
+				b_log[W_ERR] << "Unable to send " << filename << " with DCC: " << strerror(errno);
+				deinit();
+				return;
+			}
+			break;
+		}
+		if(len == 0)
+			break;
+
+		if(!first_sent.tv_sec)
+			g_get_current_time(&first_sent);
+		bytes_sent += len;
 	}
 
-	/* It does not add any \0 on buffer */
-	static char buf[512];
-	size_t len = fread(buf, sizeof(char), sizeof buf, fp);
+	if(manager)
+		manager->consume(bytes_sent - start);
+
+	/* Wait for the socket to be writable if the kernel buffer is full,
+	 * otherwise for an ack, for more data from libpurple or for the
+	 * manager to give more bandwidth. */
+	setWritable(wait);
+
+	if(turbo && total_size && bytes_sent >= total_size)
+	{
+		/* There isn't any ack in turbo mode, so the IRC user closes
+		 * the connection when he has everything. */
+		shutdown(fd, SHUT_WR);
+		eof_sent = true;
+	}
+}
+
+void DCCSend::ack(uint32_t value)
+{
+	/* Acks are only 32 bits long, so they wrap with files larger
+	 * than 4GB. */
+	size_t delta = (uint32_t)(value - (uint32_t)bytes_acked);
+	if(delta <= bytes_sent - bytes_acked)
+		bytes_acked += delta;
+}
 
-	if(len > 0)
-		send(fd, buf, len, 0);
+void DCCSend::terminated()
+{
+	GTimeVal now;
+	g_get_current_time(&now);
 
-	bytes_sent += len;
+	b_log[W_INFO] << "DCC " << type << " of " << filename << " terminated: "
+	              << bytes_sent << " bytes in " << (first_sent.tv_sec ? now.tv_sec - first_sent.tv_sec : 0) << "s ("
+	              << (unsigned)(getRate() / 1024) << " KB/s)";
+	this->deinit();
 }
 
 void DCCSend::dcc_read(int source)
 {
-	static char buffer[64];
 	ssize_t len;
 
-	len = read(source, buffer, sizeof(buffer));
+	len = read(source, rxqueue + rxlen, RXQUEUE_SIZE - rxlen);
 
 	if (len < 0 && errno == EAGAIN)
 		return;
 	else if (len <= 0) {
+		if (len == 0 && eof_sent) {
+			/* End of a turbo DCC send. */
+			terminated();
+			return;
+		}
+
 		/* DCC user has closed connection.
 		 * fd is already closed, do not let deinit()
 		 * reclose it.
@@ -221,55 +389,55 @@ void DCCSend::dcc_read(int source)
 		return;
 	}
 
-	this->rxqueue = (guchar*)g_realloc(this->rxqueue, len + this->rxlen);
-	memcpy(this->rxqueue + this->rxlen, buffer, len);
-	this->rxlen += (guint)len;
-
-	while (1) {
-		size_t acked;
-
-		if (this->rxlen < 4)
-			break;
-
-		acked = ntohl(*((gint32 *)this->rxqueue));
+	rxlen += len;
 
-		this->rxlen -= 4;
-		if (this->rxlen) {
-			unsigned char *tmp = (unsigned char*)g_memdup(this->rxqueue + 4, (guint)this->rxlen);
-			g_free(this->rxqueue);
-			this->rxqueue = tmp;
-		} else {
-			g_free(this->rxqueue);
-			this->rxqueue = NULL;
-		}
+	/* Only the last ack matters. */
+	size_t pos;
+	for(pos = 0; pos + 4 <= rxlen; pos += 4)
+	{
+		uint32_t value;
+		memcpy(&value, rxqueue + pos, sizeof value);
+		ack(ntohl(value));
+	}
+	rxlen -= pos;
+	memmove(rxqueue, rxqueue + pos, rxlen);
 
-		if (acked >= this->total_size) {
-			/* DCC send terminated \o/ */
-			this->deinit();
-			return;
-		}
+	if (total_size && bytes_acked >= total_size) {
+		/* DCC send terminated \o/ */
+		terminated();
+		return;
 	}
 
 	this->dcc_send();
 }
 
 DCCChat::DCCChat(Nick* sender, Nick* receiver)
-	: DCCServer("CHAT", "CHAT", 0, sender, receiver)
+	: DCCServer("CHAT", "CHAT", 0, sender, receiver),
+	  write_watcher(0)
 {}
 
 DCCChat::~DCCChat()
 {
-
+	deinit();
 }
 
 void DCCChat::deinit()
 {
+	if(write_watcher > 0)
+		purple_input_remove(write_watcher);
+	write_watcher = 0;
+	outbuf.clear();
+
 	DCCServer::deinit();
 }
 
 void DCCChat::dcc_read(int source)
 {
-	/* Don't care */
+	/* Don't care about what he says, but see when he leaves. */
+	char buf[512];
+	ssize_t r = recv(source, buf, sizeof buf, 0);
+	if(r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+		deinit();
 }
 
 void DCCChat::updated(bool destroy)
@@ -278,50 +446,104 @@ void DCCChat::updated(bool destroy)
 		deinit();
 }
 
+void DCCChat::dcc_write_cb(gpointer data, int source, PurpleInputCondition cond)
+{
+	DCCChat* dcc = static_cast<DCCChat*>(data);
+	dcc->flush();
+}
+
+void DCCChat::flush()
+{
+	while(!outbuf.empty())
+	{
+		ssize_t r = send(fd, outbuf.data(), outbuf.size(), 0);
+		if(r < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+
+			b_log[W_ERR] << "Unable to send to DCC CHAT: " << strerror(errno);
+			deinit();
+			return;
+		}
+		outbuf.erase(0, r);
+	}
+
+	if(!outbuf.empty() && write_watcher <= 0)
+		write_watcher = purple_input_add(fd, PURPLE_INPUT_WRITE, DCCChat::dcc_write_cb, this);
+	else if(outbuf.empty() && write_watcher > 0)
+	{
+		purple_input_remove(write_watcher);
+		write_watcher = 0;
+	}
+}
+
 void DCCChat::dcc_send(string buf)
 {
-	if(finished || listen_data || fd < 0)
+	if(!isConnected())
 		return;
 
-	send(fd, buf.c_str(), buf.size(), 0);
+	outbuf += buf;
+	flush();
+}
+
+size_t DCCChat::getBacklog() const
+{
+	size_t backlog = outbuf.size();
+#ifdef TIOCOUTQ
+	int queued = 0;
+	if(fd >= 0 && ioctl(fd, TIOCOUTQ, &queued) == 0 && queued > 0)
+		backlog += queued;
+#endif
+	return backlog;
 }
 
-DCCGet::DCCGet(Nick* _from, string _filename, uint32_t addr, uint16_t port,
-	       ssize_t size, _CallBack* _cb)
+DCCGet::DCCGet(Nick* _from, Nick* _to, string _filename, uint32_t _addr, uint16_t _port,
+	       ssize_t size, _CallBack* _cb, bool resume)
 	: from(_from),
+	  to(_to),
 	  filename(_filename),
 	  callback(_cb),
+	  addr(_addr),
+	  port(_port),
 	  finished(false),
+	  resuming(false),
 	  sock(-1),
 	  watcher(0),
-	  fp(NULL),
+	  timer(0),
+	  file_fd(-1),
 	  bytes_received(0),
-	  total_size(size)
+	  total_size(size),
+	  buffer(NULL),
+	  buflen(0)
 {
-	fp = fopen(filename.c_str(), "w");
-	if(!fp)
+	file_fd = open(filename.c_str(), O_WRONLY|O_CREAT, 0666);
+	if(file_fd < 0)
 	{
 		b_log[W_ERR] << "Unable to create local file: " << filename;
+		delete callback;
 		throw DCCGetError();
 	}
+	fcntl(file_fd, F_SETFD, FD_CLOEXEC);
 
-	struct sockaddr_in fsocket;
-
-	memset(&fsocket, 0, sizeof fsocket);
-	fsocket.sin_family = AF_INET;
-	fsocket.sin_addr.s_addr = htonl(addr);
-	fsocket.sin_port = htons(port);
-
-	sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-
-	if(connect(sock, (struct sockaddr*) &fsocket, sizeof fsocket) < 0)
+	struct stat st;
+	if(resume && fstat(file_fd, &st) == 0 && st.st_size > 0 && st.st_size < total_size)
 	{
-		b_log[W_ERR] << "Unable to receive file: " << strerror(errno);
-		delete callback;
-		throw DCCGetError();
+		/* Probably an interrupted transfer, ask to continue it. */
+		string name = filename.substr(filename.rfind('/') + 1);
+		for(string::iterator c = name.begin(); c != name.end(); ++c)
+			if(*c == '"') *c = '\'';
+
+		resuming = true;
+		to->send(Message(MSG_PRIVMSG).setSender(from)
+		                             .setReceiver(to)
+		                             .addArg("\001DCC RESUME \"" + name + "\" " + t2s(port) + " " + t2s(st.st_size) + "\001"));
+		timer = g_timeout_add_seconds(RESUME_TIMEOUT, DCCGet::resume_timeout, this);
 	}
-
-	watcher = purple_input_add(sock, PURPLE_INPUT_READ, DCCGet::dcc_read, this);
+	else
+		connect();
 }
 
 DCCGet::~DCCGet()
@@ -331,65 +553,208 @@ DCCGet::~DCCGet()
 
 void DCCGet::deinit()
 {
+	flush();
+
 	if(sock >= 0)
 		close(sock);
 	if(watcher > 0)
 		purple_input_remove(watcher);
-	if(fp != NULL)
-		fclose(fp);
+	if(timer > 0)
+		g_source_remove(timer);
+	if(file_fd >= 0)
+		close(file_fd);
 	if(callback)
 		delete callback;
+	g_free(buffer);
 
 	finished = true;
+	resuming = false;
 	sock = -1;
 	watcher = 0;
-	fp = NULL;
+	timer = 0;
+	file_fd = -1;
 	callback = NULL;
+	buffer = NULL;
+	buflen = 0;
 }
 
-void DCCGet::dcc_read(gpointer data, int source, PurpleInputCondition cond)
+bool DCCGet::accept(uint16_t _port, ssize_t position)
+{
+	if(!resuming || _port != port)
+		return false;
+
+	if(position < 0 || position > total_size)
+		position = 0;
+
+	b_log[W_INFO|W_SNO] << "Resuming transfer of " << filename << " from " << position << " bytes";
+
+	resuming = false;
+	if(timer > 0)
+		g_source_remove(timer);
+	timer = 0;
+
+	bytes_received = position;
+	connect();
+	return true;
+}
+
+gboolean DCCGet::resume_timeout(gpointer data)
 {
 	DCCGet* dcc = static_cast<DCCGet*>(data);
-	static char buffer[1024];
-	ssize_t len;
 
-	len = read(source, buffer, sizeof(buffer));
+	/* IRC user does not support resuming, restart from beginning. */
+	dcc->timer = 0;
+	dcc->resuming = false;
+	dcc->bytes_received = 0;
+	dcc->connect();
+	return FALSE;
+}
 
-	if (len < 0 && errno == EAGAIN)
+void DCCGet::connect()
+{
+	if(bytes_received == 0 && ftruncate(file_fd, 0) < 0)
+	{
+		b_log[W_ERR] << "Unable to truncate " << filename << ": " << strerror(errno);
+		deinit();
 		return;
-	else if (len <= 0) {
-		/* DCC user has closed connection.
-		 * fd is already closed, do not let deinit()
-		 * reclose it.
-		 */
-		dcc->sock = -1;
-		dcc->deinit();
+	}
+
+	struct sockaddr_in fsocket;
+
+	memset(&fsocket, 0, sizeof fsocket);
+	fsocket.sin_family = AF_INET;
+	fsocket.sin_addr.s_addr = htonl(addr);
+	fsocket.sin_port = htons(port);
+
+	sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if(sock < 0)
+	{
+		b_log[W_ERR] << "Unable to receive file: " << strerror(errno);
+		deinit();
 		return;
 	}
 
-	if(fwrite(buffer, sizeof(char), len, dcc->fp) < (size_t)len)
+	int flags = fcntl(sock, F_GETFL);
+	fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+	fcntl(sock, F_SETFD, FD_CLOEXEC);
+
+	if(::connect(sock, (struct sockaddr*) &fsocket, sizeof fsocket) < 0 && errno != EINPROGRESS)
 	{
-		b_log[W_ERR] << "Unable to write received data: " << strerror(errno);
+		b_log[W_ERR] << "Unable to receive file: " << strerror(errno);
+		deinit();
+		return;
+	}
+
+	watcher = purple_input_add(sock, PURPLE_INPUT_WRITE, DCCGet::connected, this);
+	timer = g_timeout_add_seconds(CONNECT_TIMEOUT, DCCGet::connect_timeout, this);
+}
+
+gboolean DCCGet::connect_timeout(gpointer data)
+{
+	DCCGet* dcc = static_cast<DCCGet*>(data);
+
+	b_log[W_ERR] << "Unable to receive file " << dcc->filename << ": connection timeout";
+	dcc->timer = 0;
+	dcc->deinit();
+	return FALSE;
+}
+
+void DCCGet::connected(gpointer data, int source, PurpleInputCondition cond)
+{
+	DCCGet* dcc = static_cast<DCCGet*>(data);
+	int error = 0;
+	socklen_t len = sizeof error;
+
+	purple_input_remove(dcc->watcher);
+	dcc->watcher = 0;
+	g_source_remove(dcc->timer);
+	dcc->timer = 0;
+
+	if(getsockopt(source, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0)
+	{
+		b_log[W_ERR] << "Unable to receive file: " << strerror(error ? error : errno);
 		dcc->deinit();
 		return;
 	}
 
-	dcc->bytes_received += len;
-	if(dcc->bytes_received >= dcc->total_size)
+	dcc->buffer = (guchar*)g_malloc(BUFFER_SIZE);
+	dcc->watcher = purple_input_add(source, PURPLE_INPUT_READ, DCCGet::dcc_read, dcc);
+}
+
+bool DCCGet::flush()
+{
+	size_t done = 0;
+	off_t offset = bytes_received - buflen;
+
+	while(done < buflen)
 	{
-		unsigned long l = htonl(dcc->bytes_received);
-		size_t result = write(dcc->sock, &l, sizeof(l));
-		if(result != sizeof(l))
-			b_log[W_WARNING] << "Unable to send DCC ack";
+		ssize_t len = pwrite(file_fd, buffer + done, buflen - done, offset + done);
+		if(len < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			b_log[W_ERR] << "Unable to write received data: " << strerror(errno);
+			buflen = 0;
+			return false;
+		}
+		done += len;
+	}
 
-		if(dcc->callback)
+	buflen = 0;
+	return true;
+}
+
+void DCCGet::sendAck()
+{
+	/* Acks are only 32 bits long. */
+	uint32_t l = htonl((uint32_t)bytes_received);
+	if(write(sock, &l, sizeof l) != sizeof l)
+		b_log[W_WARNING] << "Unable to send DCC ack";
+}
+
+void DCCGet::dcc_read(gpointer data, int source, PurpleInputCondition cond)
+{
+	DCCGet* dcc = static_cast<DCCGet*>(data);
+	ssize_t len = 0;
+	bool received = false;
+
+	while(dcc->buflen < BUFFER_SIZE &&
+	      (len = read(source, dcc->buffer + dcc->buflen, BUFFER_SIZE - dcc->buflen)) > 0)
+	{
+		dcc->buflen += len;
+		dcc->bytes_received += len;
+		received = true;
+	}
+
+	if(dcc->buflen >= BUFFER_SIZE || dcc->bytes_received >= dcc->total_size || len == 0)
+	{
+		if(!dcc->flush())
 		{
-			fflush(dcc->fp);
-			dcc->callback->run();
+			dcc->deinit();
+			return;
 		}
+	}
+
+	if(received)
+		dcc->sendAck();
+
+	if(dcc->bytes_received >= dcc->total_size)
+	{
+		if(dcc->callback)
+			dcc->callback->run();
 		dcc->deinit();
+		return;
 	}
 
+	if (len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+		/* DCC user has closed connection.
+		 * Received data is kept to resume the transfer later.
+		 */
+		b_log[W_ERR] << "Transfer of " << dcc->filename << " interrupted after "
+		             << dcc->bytes_received << " bytes";
+		dcc->deinit();
+		return;
+	}
 }
 
 void DCCGet::updated(bool destroy)
@@ -407,22 +772,28 @@ void DCCGet::setPeer(Nick* n)
 		deinit();
 }
 
-bool DCCGet::parseDCCSEND(string line, string* filename, uint32_t* addr, uint16_t* port, ssize_t* size)
+bool DCCGet::parseCTCP(string line, Message* args)
 {
-	if(line[0] != '\1' || line[line.size() - 1] != '\1')
+	if(line.size() < 2 || line[0] != '\1' || line[line.size() - 1] != '\1')
 		return false;
 
 	string word;
-	Message args;
 
 	/* Remove \1 chars. */
 	line = line.substr(1, line.size()-2);
 
 	while((word = stringtok(line, " ")).empty() == false)
-		args.addArg(word);
-	args.rebuildWithQuotes();
+		args->addArg(word);
+	args->rebuildWithQuotes();
 
-	if(args.countArgs() == 6 && args.getArg(0) == "DCC" && args.getArg(1) == "SEND")
+	return args->countArgs() > 1 && args->getArg(0) == "DCC";
+}
+
+bool DCCGet::parseDCCSEND(string line, string* filename, uint32_t* addr, uint16_t* port, ssize_t* size)
+{
+	Message args;
+
+	if(parseCTCP(line, &args) && args.countArgs() == 6 && args.getArg(1) == "SEND")
 	{
 		*filename = args.getArg(2);
 		*addr = s2t<uint32_t>(args.getArg(3));
@@ -434,4 +805,19 @@ bool DCCGet::parseDCCSEND(string line, string* filename, uint32_t* addr, uint16_
 	return false;
 }
 
+bool DCCGet::parseDCCACCEPT(string line, string* filename, uint16_t* port, ssize_t* position)
+{
+	Message args;
+
+	if(parseCTCP(line, &args) && args.countArgs() == 5 && args.getArg(1) == "ACCEPT")
+	{
+		*filename = args.getArg(2);
+		*port = s2t<uint16_t>(args.getArg(3));
+		*position = s2t<ssize_t>(args.getArg(4));
+		return true;
+	}
+
+	return false;
+}
+
 } /* namespace irc */
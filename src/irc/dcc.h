@@ -31,6 +31,8 @@ namespace irc {
 
 	using std::string;
 	class Nick;
+	class Message;
+	class TransferManager;
 
 	/* Exceptions */
 	class DCCListenError : public std::exception {};
@@ -38,15 +40,29 @@ namespace irc {
 
 	class DCC
 	{
+	protected:
+		TransferManager* manager;    /**< shapes the transfer, if any */
+
 	public:
 
+		DCC() : manager(NULL) {}
 		virtual ~DCC() {}
 
+		void setManager(TransferManager* m) { manager = m; }
+
 		virtual im::FileTransfert getFileTransfert() const = 0;
 		virtual void updated(bool destroy) = 0;
 		virtual bool isFinished() const = 0;
 		virtual Nick* getPeer() const = 0;
 		virtual void setPeer(Nick* n) = 0;
+
+		virtual string getType() const = 0;
+		virtual string getFileName() const = 0;
+		virtual size_t getTotalSize() const = 0;
+		virtual size_t getBytesTransferred() const = 0;
+
+		/** Bytes sent but not acked by the peer yet. */
+		virtual size_t getBytesInFlight() const { return 0; }
 	};
 
 	class DCCServer : public DCC
@@ -82,6 +98,10 @@ namespace irc {
 
 		Nick* getPeer() const { return sender; }
 		void setPeer(Nick* n) { sender = n; }
+
+		string getType() const { return type; }
+		string getFileName() const { return filename; }
+		size_t getTotalSize() const { return total_size; }
 	};
 
 	/** The DCC class used to send a file to a IRC user.
@@ -90,12 +110,18 @@ namespace irc {
 	 * on im->minbif. It creates a DCC server on a random port.
 	 *
 	 * When IRC user is connected on server, try to open the file that
-	 * libpurple is currently writting. If success, read 512 bytes and
-	 * send it to IRC user with DCC connection.
+	 * libpurple is currently writting. If success, send what is
+	 * available with sendfile(), without having more than the window
+	 * size not acked by IRC user. In turbo mode (TSEND), IRC user does
+	 * not send any ack, and data is sent as soon as it is available.
+	 *
+	 * In streaming mode, libpurple does not write the file, and data
+	 * is read from an im::XferPipe instead.
 	 *
-	 * Everytimes we receive an ACK from IRC user on DCC connection, or
-	 * when libpurple sends us a percentage update, retry to send data
-	 * to DCC user.
+	 * Everytimes we receive an ACK from IRC user on DCC connection, when
+	 * the socket is writable again, when libpurple sends us a
+	 * percentage update, or when the TransferManager has bandwidth
+	 * again, retry to send data to DCC user.
 	 *
 	 * When im->minbif transfert is finished, the minbif->irc transfert
 	 * isn't finished. So the 'ft' reference is removed, and this is the
@@ -110,14 +136,29 @@ namespace irc {
 
 		string local_filename;
 
+		bool turbo;
+		size_t window;
+		im::XferPipe* pipe;     /**< data streamed from libpurple, if any */
+		int file_fd;
+		int write_watcher;
+		bool eof_sent;
+
 		size_t bytes_sent;
-		FILE* fp;
-		guint rxlen;
-		guchar* rxqueue;
+		size_t bytes_acked;
+		GTimeVal first_sent;
+
+		static const size_t RXQUEUE_SIZE = 64;
+		guchar rxqueue[RXQUEUE_SIZE];
+		size_t rxlen;
+
+		static void dcc_write_cb(gpointer data, int source, PurpleInputCondition cond);
 
 		virtual void deinit();
 		virtual void dcc_read(int source);
 		void dcc_send();
+		void setWritable(bool wait);
+		void ack(uint32_t value);
+		void terminated();
 
 	public:
 		DCCSend(const im::FileTransfert& ft, Nick* sender, Nick* receiver);
@@ -125,12 +166,31 @@ namespace irc {
 
 		im::FileTransfert getFileTransfert() const { return ft; }
 		void updated(bool destroy);
+
+		size_t getBytesSent() const { return bytes_sent; }
+		size_t getBytesAcked() const { return bytes_acked; }
+		size_t getBytesTransferred() const { return bytes_sent; }
+		size_t getBytesInFlight() const { return turbo ? 0 : bytes_sent - bytes_acked; }
+
+		/** Average throughput since first data was sent, in bytes/s. */
+		double getRate() const;
 	};
 
+	/** The DCC class used to send text to the IRC user.
+	 *
+	 * Data which the socket doesn't accept at once is kept and sent
+	 * when it is writable again, so nothing is lost, and getBacklog()
+	 * lets the caller slow down when the link can't follow.
+	 */
 	class DCCChat : public DCCServer
 	{
+		string outbuf;
+		int write_watcher;
+
 		virtual void deinit();
 		virtual void dcc_read(int source);
+		static void dcc_write_cb(gpointer data, int source, PurpleInputCondition cond);
+		void flush();
 	public:
 
 		DCCChat(Nick* sender, Nick* receiver);
@@ -139,36 +199,91 @@ namespace irc {
 		im::FileTransfert getFileTransfert() const { return im::FileTransfert(); }
 		void updated(bool destroy);
 		void dcc_send(string buf);
+		size_t getBytesTransferred() const { return 0; }
+
+		/** The IRC user is connected. */
+		bool isConnected() const { return !finished && !listen_data && fd >= 0; }
+
+		/** Bytes not received by the IRC user yet, in our buffer and,
+		 * when the system tells it, in the socket send queue. */
+		size_t getBacklog() const;
 	};
 
+	/** The DCC class used to receive a file from the IRC user.
+	 *
+	 * Connection to the IRC user is asynchronous, and received data
+	 * is buffered before being written in the file.
+	 *
+	 * If resuming is allowed and a shorter file with the same name
+	 * exists, probably from an interrupted transfer, a DCC RESUME
+	 * request is sent to the IRC user. When he answers with DCC ACCEPT,
+	 * the transfer continues from the given position. Without answer,
+	 * the file is received from the beginning.
+	 */
 	class DCCGet : public DCC
 	{
 		Nick* from;
+		Nick* to;
 		string filename;
 		_CallBack* callback;
+		uint32_t addr;
+		uint16_t port;
 
 		bool finished;
+		bool resuming;
 		int sock;
 		int watcher;
-		FILE* fp;
-		ssize_t bytes_received;
+		guint timer;
+		int file_fd;
+		ssize_t bytes_received;    /**< position in file */
 		ssize_t total_size;
 
+		guchar* buffer;
+		size_t buflen;
+
+		static const time_t CONNECT_TIMEOUT = 30;
+		static const time_t RESUME_TIMEOUT = 10;
+		static const size_t BUFFER_SIZE = 256 * 1024;
+
 		void deinit();
+		void connect();
+		bool flush();
+		void sendAck();
+		static void connected(gpointer data, int source, PurpleInputCondition cond);
 		static void dcc_read(gpointer data, int source, PurpleInputCondition cond);
+		static gboolean connect_timeout(gpointer data);
+		static gboolean resume_timeout(gpointer data);
+		static bool parseCTCP(string line, Message* args);
 	public:
 
-		/** Get a file from a user, and call a method when it is finished. */
-		DCCGet(Nick* from, string filename, uint32_t addr, uint16_t port, ssize_t size, _CallBack* callback);
+		/** Get a file from a user, and call a method when it is finished.
+		 *
+		 * @param from  nick the file is sent to
+		 * @param to  IRC user who sends the file
+		 * @param resume  allow to resume a previous transfer
+		 */
+		DCCGet(Nick* from, Nick* to, string filename, uint32_t addr, uint16_t port, ssize_t size, _CallBack* callback, bool resume = false);
 		~DCCGet();
 
 		static bool parseDCCSEND(string line, string* filename, uint32_t* addr, uint16_t* port, ssize_t* size);
+		static bool parseDCCACCEPT(string line, string* filename, uint16_t* port, ssize_t* position);
+
+		/** IRC user has accepted to resume the transfer.
+		 *
+		 * @return  false if this transfer isn't waiting for it.
+		 */
+		bool accept(uint16_t port, ssize_t position);
 
 		virtual im::FileTransfert getFileTransfert() const { return im::FileTransfert(); }
 		virtual void updated(bool destroy);
 		virtual bool isFinished() const { return finished; }
 		virtual Nick* getPeer() const { return from; }
 		virtual void setPeer(Nick* n);
+
+		virtual string getType() const { return "GET"; }
+		virtual string getFileName() const { return filename; }
+		virtual size_t getTotalSize() const { return total_size > 0 ? (size_t)total_size : 0; }
+		virtual size_t getBytesTransferred() const { return (size_t)bytes_received; }
 	};
 
 
@@ -21,17 +21,20 @@
 #include <cstring>
 #include <algorithm>
 #include <fstream>
-#include <fnmatch.h>
 
 #include "core/log.h"
 #include "core/util.h"
 #include "core/version.h"
+#include "core/caca_renderer.h"
 #include "server_poll/poll.h"
 #include "irc/irc.h"
 #include "irc/buddy.h"
 #include "irc/dcc.h"
+#include "irc/transfer_manager.h"
 #include "irc/user.h"
 #include "irc/channel.h"
+#include "irc/mask.h"
+#include "im/auth_worker.h"
 
 namespace irc {
 
@@ -62,6 +65,8 @@ IRC::command_t IRC::commands[] = {
 	{ MSG_LIST,    &IRC::m_list,    0, 0, Nick::REGISTERED },
 	{ MSG_MODE,    &IRC::m_mode,    1, 0, Nick::REGISTERED },
 	{ MSG_ISON,    &IRC::m_ison,    1, 0, Nick::REGISTERED },
+	{ MSG_MONITOR, &IRC::m_monitor, 1, 0, Nick::REGISTERED },
+	{ MSG_WATCH,   &IRC::m_watch,   0, 0, Nick::REGISTERED },
 	{ MSG_INVITE,  &IRC::m_invite,  2, 0, Nick::REGISTERED },
 	{ MSG_KICK,    &IRC::m_kick,    2, 0, Nick::REGISTERED },
 	{ MSG_KILL,    &IRC::m_kill,    1, 0, Nick::REGISTERED },
@@ -86,7 +91,10 @@ IRC::IRC(ServerPoll* _poll, sock::SockWrapper* _sockw, string _hostname, unsigne
 	  ping_cb(NULL),
 	  user(NULL),
 	  im(NULL),
-	  im_auth(NULL)
+	  im_auth(NULL),
+	  auth_worker(NULL),
+	  auth_trusted(false),
+	  transfers(NULL)
 {
 	/* Get my own hostname (if not given in arguments) */
 	if(_hostname.empty() || _hostname == " ")
@@ -104,6 +112,8 @@ IRC::IRC(ServerPoll* _poll, sock::SockWrapper* _sockw, string _hostname, unsigne
 	read_cb = new CallBack<IRC>(this, &IRC::readIO);
 	sockw->AttachCallback(PURPLE_INPUT_READ, read_cb);
 
+	transfers = new TransferManager(poll);
+
 	/* Create main objects and root joins command channel. */
 	user = new User(sockw, this, "*", "", sockw->GetClientHostname());
 	addNick(user);
@@ -122,6 +132,8 @@ IRC::IRC(ServerPoll* _poll, sock::SockWrapper* _sockw, string _hostname, unsigne
 
 IRC::~IRC()
 {
+	CacaRenderer::cancel(this);
+	delete auth_worker;
 	delete im;
 	if (im_auth)
 		delete im_auth;
@@ -135,49 +147,32 @@ IRC::~IRC()
 	cleanUpNicks();
 	cleanUpServers();
 	cleanUpChannels();
-	cleanUpDCC();
+	delete transfers;
 }
 
 DCC* IRC::createDCCSend(const im::FileTransfert& ft, Nick* n)
 {
 	DCC* dcc = new DCCSend(ft, n, user);
-	dccs.push_back(dcc);
+	transfers->add(dcc);
 	return dcc;
 }
 
 DCC* IRC::createDCCGet(Nick* from, string filename, uint32_t addr,
-		       uint16_t port, ssize_t size, _CallBack* callback)
+		       uint16_t port, ssize_t size, _CallBack* callback, bool resume)
 {
-	DCC* dcc = new DCCGet(from, filename, addr, port, size, callback);
-	dccs.push_back(dcc);
+	DCC* dcc = new DCCGet(from, user, filename, addr, port, size, callback, resume);
+	transfers->add(dcc);
 	return dcc;
 }
 
-void IRC::updateDCC(const im::FileTransfert& ft, bool destroy)
+bool IRC::acceptDCCResume(Nick* from, uint16_t port, ssize_t position)
 {
-	for(vector<DCC*>::iterator it = dccs.begin(); it != dccs.end();)
-	{
-		/* Purge */
-		if((*it)->isFinished())
-		{
-			delete *it;
-			it = dccs.erase(it);
-		}
-		else
-		{
-			if((*it)->getFileTransfert() == ft)
-				(*it)->updated(destroy);
-			++it;
-		}
-	}
+	return transfers->acceptResume(from, port, position);
 }
 
-void IRC::cleanUpDCC()
+void IRC::updateDCC(const im::FileTransfert& ft, bool destroy)
 {
-	for(vector<DCC*>::iterator it = dccs.begin(); it != dccs.end(); ++it)
-		delete *it;
-
-	dccs.clear();
+	transfers->update(ft, destroy);
 }
 
 void IRC::addChannel(Channel* chan)
@@ -216,28 +211,50 @@ void IRC::cleanUpChannels()
 
 void IRC::addNick(Nick* nick)
 {
-	if(users.find(nick->getNickname()) != users.end())
+	map<string, Nick*>::iterator it = users.find(nick->getNickname());
+	if(it != users.end())
+	{
 		b_log[W_DESYNCH] << "/!\\ User " << nick->getNickname() << " already exists!";
+		unindexNick(it->second);
+	}
 	users[nick->getNickname()] = nick;
+	users_lc.insert(std::make_pair(strlower(nick->getNickname()), nick));
 	nick->getServer()->addNick(nick);
+	updateMonitor(nick->getNickname());
+}
+
+void IRC::unindexNick(Nick* nick)
+{
+	std::pair<multimap<string, Nick*>::iterator, multimap<string, Nick*>::iterator> range;
+	range = users_lc.equal_range(strlower(nick->getNickname()));
+	for(multimap<string, Nick*>::iterator it = range.first; it != range.second; ++it)
+		if(it->second == nick)
+		{
+			users_lc.erase(it);
+			return;
+		}
 }
 
 void IRC::renameNick(Nick* nick, string newnick)
 {
-	users.erase(nick->getNickname());
+	string oldnick = nick->getNickname();
+	users.erase(oldnick);
+	unindexNick(nick);
 	nick->setNickname(newnick);
 	addNick(nick);
+	updateMonitor(oldnick);
 }
 
 Nick* IRC::getNick(string nickname, bool case_sensitive) const
 {
-	map<string, Nick*>::const_iterator it;
-	if(!case_sensitive)
-		nickname = strlower(nickname);
-	for(it = users.begin(); it != users.end() && (case_sensitive ? it->first : strlower(it->first)) != nickname; ++it)
-		;
+	if(case_sensitive)
+	{
+		map<string, Nick*>::const_iterator it = users.find(nickname);
+		return it != users.end() ? it->second : NULL;
+	}
 
-	if(it == users.end())
+	multimap<string, Nick*>::const_iterator it = users_lc.find(strlower(nickname));
+	if(it == users_lc.end())
 		return 0;
 
 	return it->second;
@@ -275,26 +292,49 @@ ConvNick* IRC::getNick(const im::Conversation& conv) const
 
 vector<Nick*> IRC::matchNick(string pattern) const
 {
-	map<string, Nick*>::const_iterator it;
+	return matchNick(Mask(pattern));
+}
+
+vector<Nick*> IRC::matchNick(const Mask& mask) const
+{
 	vector<Nick*> result;
+	string prefix = mask.getNickPrefix();
+	string accid = mask.getAccountID();
 
-	if (pattern.find('!') == string::npos)
+	if (!prefix.empty())
 	{
-		if (pattern.find('@') != string::npos)
-			pattern = "*!" + pattern;
-		else if (pattern.find(':') != string::npos)
-			pattern = "*!*@" + pattern;
-		else
-			pattern = pattern + "!*@*";
+		/* Only walk nicks which start with the literal prefix. */
+		multimap<string, Nick*>::const_iterator it;
+		for (it = users_lc.lower_bound(prefix);
+		     it != users_lc.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+		     ++it)
+			if (mask.match(it->second))
+				result.push_back(it->second);
 	}
-	else if (pattern.find('@') == string::npos)
-		pattern += "@*";
-
-	for (it = users.begin(); it != users.end(); ++it)
+	else if (!accid.empty())
+	{
+		/* Only look at nicks of this account, and at our own
+		 * ones which may have any hostname. */
+		set<Nick*> nicks = getNicks();
+		for (map<string, Server*>::const_iterator s = servers.begin(); s != servers.end(); ++s)
+		{
+			RemoteServer* rt = dynamic_cast<RemoteServer*>(s->second);
+			if (rt && strlower(rt->getAccount().getID()) == accid)
+			{
+				set<Nick*> accnicks = rt->getNicks();
+				nicks.insert(accnicks.begin(), accnicks.end());
+			}
+		}
+		FOREACH(set<Nick*>, nicks, n)
+			if (mask.match(*n))
+				result.push_back(*n);
+	}
+	else
 	{
-		string longname = it->second->getLongName();
-		if (!fnmatch(pattern.c_str(), longname.c_str(), FNM_NOESCAPE|FNM_CASEFOLD))
-			result.push_back(it->second);
+		map<string, Nick*>::const_iterator it;
+		for (it = users.begin(); it != users.end(); ++it)
+			if (mask.match(it->second))
+				result.push_back(it->second);
 	}
 
 	return result;
@@ -305,21 +345,14 @@ void IRC::removeNick(string nickname)
 	map<string, Nick*>::iterator it = users.find(nickname);
 	if(it != users.end())
 	{
-		for(vector<DCC*>::iterator dcc = dccs.begin(); dcc != dccs.end();)
-			if((*dcc)->isFinished())
-			{
-				delete *dcc;
-				dcc = dccs.erase(dcc);
-			}
-			else
-			{
-				if((*dcc)->getPeer() == it->second)
-					(*dcc)->setPeer(NULL);
-				++dcc;
-			}
+		set<Nick*> peer;
+		peer.insert(it->second);
+		transfers->removePeers(peer);
 		it->second->getServer()->removeNick(it->second);
+		unindexNick(it->second);
 		delete it->second;
 		users.erase(it);
+		updateMonitor(nickname);
 	}
 }
 
@@ -332,6 +365,7 @@ void IRC::cleanUpNicks()
 		delete it->second;
 	}
 	users.clear();
+	users_lc.clear();
 }
 
 void IRC::addServer(Server* server)
@@ -351,22 +385,53 @@ Server* IRC::getServer(string servername) const
 void IRC::removeServer(string servername)
 {
 	map<string, Server*>::iterator it = servers.find(servername);
-	if(it != servers.end())
+	if(it == servers.end())
+		return;
+
+	Server* server = it->second;
+	set<Nick*> nicks = server->getNicks();
+	set<Channel*> chans;
+
+	/* Send one QUIT per nick. Other channel members are IM users which
+	 * don't care about it, so only the IRC user is told, once. */
+	FOREACH(set<Nick*>, nicks, nt)
 	{
-		/* Cleanup server's users */
-		for(map<string, Nick*>::iterator nt = users.begin(); nt != users.end();)
-			if(nt->second->getServer() == it->second)
-			{
-				delete nt->second;
-				users.erase(nt);
-				nt = users.begin();
-			}
-			else
-				++nt;
+		Nick* n = *nt;
+		bool seen = false;
+		vector<ChanUser*> cus = n->getChannels();
+		FOREACH(vector<ChanUser*>, cus, cu)
+		{
+			Channel* chan = (*cu)->getChannel();
+			chans.insert(chan);
+			if(!seen && user->isOn(chan))
+				seen = true;
+		}
+		if(seen)
+			user->send(Message(MSG_QUIT).setSender(n)
+				                    .addArg("*.net *.split"));
+	}
 
-		delete it->second;
-		servers.erase(it);
+	/* Then remove them from channels in batch. */
+	FOREACH(set<Channel*>, chans, chan)
+		(*chan)->delUsers(nicks);
+
+	transfers->removePeers(nicks);
+
+	vector<string> nicknames;
+	FOREACH(set<Nick*>, nicks, nt)
+	{
+		nicknames.push_back((*nt)->getNickname());
+		users.erase((*nt)->getNickname());
+		unindexNick(*nt);
+		server->removeNick(*nt);
+		delete *nt;
 	}
+
+	delete server;
+	servers.erase(it);
+
+	FOREACH(vector<string>, nicknames, nickname)
+		updateMonitor(*nickname);
 }
 
 void IRC::cleanUpServers()
@@ -380,6 +445,7 @@ void IRC::cleanUpServers()
 void IRC::rehash(bool verbose)
 {
 	setMotd(conf.GetSection("path")->GetItem("motd")->String());
+	transfers->rehash();
 	if(verbose)
 		b_log[W_INFO|W_SNO] << "Server configuration rehashed.";
 }
@@ -417,18 +483,89 @@ void IRC::quit(string reason)
 void IRC::sendWelcome()
 {
 	if(user->hasFlag(Nick::REGISTERED) || user->getNickname() == "*" ||
-	   user->getIdentname().empty())
+	   user->getIdentname().empty() || auth_worker)
+		return;
+
+	try
+	{
+		auth_worker = new im::AuthWorker(this, user->getNickname(), user->getPassword(),
+		                                 new CallBack<IRC>(this, &IRC::authenticated));
+	}
+	catch(im::IMError& e)
+	{
+		quit("Unable to initialize IM: " + e.Reason());
+		return;
+	}
+
+	/* Without IPC, there is no cache to ask. */
+	if(!poll->ipc_send(Message(MSG_AUTH).addArg("CHECK")
+			                    .addArg(user->getNickname())
+			                    .addArg(im::AuthCache::digest(user->getNickname(), user->getPassword()))))
+		auth_worker->start();
+}
+
+void IRC::authCached(im::AuthCache::result_t result, unsigned delay)
+{
+	if(!auth_worker)
 		return;
 
+	switch(result)
+	{
+		case im::AuthCache::LOCKED:
+			delete auth_worker;
+			auth_worker = NULL;
+			quit("Too many authentication failures, retry in " + t2s(delay) + " seconds");
+			break;
+		case im::AuthCache::INVALID:
+			delete auth_worker;
+			auth_worker = NULL;
+			quit("Incorrect credentials");
+			break;
+		case im::AuthCache::VALID:
+			auth_trusted = true;
+			auth_worker->start(true);
+			break;
+		case im::AuthCache::UNKNOWN:
+			auth_worker->start();
+			break;
+	}
+}
+
+void IRC::credentialsChanged()
+{
+	poll->ipc_send(Message(MSG_AUTH).addArg("FORGET").addArg(user->getNickname()));
+}
+
+bool IRC::authenticated(void*)
+{
+	im::AuthWorker* worker = auth_worker;
+	auth_worker = NULL;
+
+	/* Give the slot back to the master. */
+	poll->ipc_send(Message(MSG_AUTH).addArg("DONE").addArg(user->getNickname()));
+
 	try
 	{
-		im_auth = im::Auth::validate(this, user->getNickname(), user->getPassword());
+		if (worker->hasTimedOut())
+		{
+			delete worker;
+			quit("Authentication timeout");
+			return false;
+		}
+
+		im_auth = worker->getAuth();
+		delete worker;
+		worker = NULL;
+
 		if (!im_auth)
 		{
 			if (im::IM::exists(user->getNickname()))
 			{
+				poll->ipc_send(Message(MSG_AUTH).addArg("INVALID")
+						                .addArg(user->getNickname())
+						                .addArg(im::AuthCache::digest(user->getNickname(), user->getPassword())));
 				quit("Incorrect credentials");
-				return;
+				return false;
 			}
 
 			/* New User */
@@ -436,13 +573,22 @@ void IRC::sendWelcome()
 			if(global_passwd != " " && user->getPassword() != global_passwd)
 			{
 				quit("This server is protected by a global private password.  Ask administrator.");
-				return;
+				return false;
 			}
 
 			im_auth = im::Auth::generate(this, user->getNickname(), user->getPassword());
 			if (!im_auth)
+			{
 				quit("Creation of new account failed");
+				return false;
+			}
 		}
+		else if (im_auth->isBlocking() && !auth_trusted)
+			/* Only passwords checked by blocking mechanisms are
+			 * cached, as the others are cheap. */
+			poll->ipc_send(Message(MSG_AUTH).addArg("VALID")
+					                .addArg(user->getNickname())
+					                .addArg(im::AuthCache::digest(user->getNickname(), user->getPassword())));
 
 		im = im_auth->getIM();
 
@@ -464,6 +610,10 @@ void IRC::sendWelcome()
 										  .addArg("CHANTYPES=#&")
 										  .addArg("PREFIX=(qohv)~@%+")
 										  .addArg("STATUSMSG=~@%+")
+										  .addArg("MONITOR=" + t2s((unsigned)MONITOR_LIMIT))
+										  .addArg("WATCH=" + t2s((unsigned)MONITOR_LIMIT))
+										  .addArg("WHOX")
+										  .addArg("ELIST=MNU")
 										  .addArg("are supported by this server"));
 
 		m_motd(Message());
@@ -480,8 +630,25 @@ void IRC::sendWelcome()
 	}
 	catch(im::IMError& e)
 	{
+		delete worker;
 		quit("Unable to initialize IM: " + e.Reason());
+		return false;
+	}
+
+	/* Handle lines received while authenticating. */
+	vector<string> lines;
+	lines.swap(auth_input);
+	try
+	{
+		for(vector<string>::iterator it = lines.begin(); it != lines.end() && sockw; ++it)
+			parseLine(*it);
 	}
+	catch (sock::SockError &e)
+	{
+		quit(e.Reason());
+	}
+
+	return false;
 }
 
 bool IRC::ping(void*)
@@ -520,6 +687,46 @@ void IRC::privmsg(Nick* nick, string msg)
 					       .addArg(tmp));
 }
 
+void IRC::parseLine(const string& line)
+{
+	Message m = Message::parse(line);
+	b_log[W_PARSE] << "<< " << line;
+	size_t i;
+	for(i = 0;
+	    commands[i].cmd != NULL && strcmp(commands[i].cmd, m.getCommand().c_str());
+	    ++i)
+		;
+
+	user->setLastReadNow();
+
+	if(commands[i].cmd == NULL)
+		user->send(Message(ERR_UNKNOWNCOMMAND).setSender(this)
+						   .setReceiver(user)
+						   .addArg(m.getCommand())
+						   .addArg("Unknown command"));
+	else if(m.countArgs() < commands[i].minargs)
+		user->send(Message(ERR_NEEDMOREPARAMS).setSender(this)
+						   .setReceiver(user)
+						   .addArg(m.getCommand())
+						   .addArg("Not enough parameters"));
+	else if(commands[i].flags && !user->hasFlag(commands[i].flags))
+	{
+		if(!user->hasFlag(Nick::REGISTERED))
+			user->send(Message(ERR_NOTREGISTERED).setSender(this)
+							     .setReceiver(user)
+							     .addArg("Register first"));
+		else
+			user->send(Message(ERR_NOPRIVILEGES).setSender(this)
+							    .setReceiver(user)
+							    .addArg("Permission Denied: Insufficient privileges"));
+	}
+	else
+	{
+		commands[i].count++;
+		(this->*commands[i].func)(m);
+	}
+}
+
 bool IRC::readIO(void*)
 {
 	try
@@ -528,44 +735,12 @@ bool IRC::readIO(void*)
 
 		sbuf = sockw->Read();
 
-		while((line = stringtok(sbuf, "\r\n")).empty() == false)
+		while((line = stringtok(sbuf, "\r\n")).empty() == false && sockw)
 		{
-			Message m = Message::parse(line);
-			b_log[W_PARSE] << "<< " << line;
-			size_t i;
-			for(i = 0;
-			    commands[i].cmd != NULL && strcmp(commands[i].cmd, m.getCommand().c_str());
-			    ++i)
-				;
-
-			user->setLastReadNow();
-
-			if(commands[i].cmd == NULL)
-				user->send(Message(ERR_UNKNOWNCOMMAND).setSender(this)
-								   .setReceiver(user)
-								   .addArg(m.getCommand())
-								   .addArg("Unknown command"));
-			else if(m.countArgs() < commands[i].minargs)
-				user->send(Message(ERR_NEEDMOREPARAMS).setSender(this)
-								   .setReceiver(user)
-								   .addArg(m.getCommand())
-								   .addArg("Not enough parameters"));
-			else if(commands[i].flags && !user->hasFlag(commands[i].flags))
-			{
-				if(!user->hasFlag(Nick::REGISTERED))
-					user->send(Message(ERR_NOTREGISTERED).setSender(this)
-									     .setReceiver(user)
-									     .addArg("Register first"));
-				else
-					user->send(Message(ERR_NOPRIVILEGES).setSender(this)
-									    .setReceiver(user)
-									    .addArg("Permission Denied: Insufficient privileges"));
-			}
+			if(auth_worker)
+				auth_input.push_back(line);
 			else
-			{
-				commands[i].count++;
-				(this->*commands[i].func)(m);
-			}
+				parseLine(line);
 		}
 	}
 	catch (sock::SockError &e)
@@ -27,6 +27,7 @@
 #include "message.h"
 #include "server.h"
 #include "im/auth.h"
+#include "im/auth_cache.h"
 #include "sockwrap/sockwrap.h"
 #include "core/exception.h"
 
@@ -36,6 +37,7 @@ class ServerPoll;
 namespace im
 {
 	class IM;
+	class AuthWorker;
 	class Account;
 	class Buddy;
 	class Conversation;
@@ -47,6 +49,7 @@ namespace irc
 {
 	using std::string;
 	using std::map;
+	using std::multimap;
 
 	class User;
 	class Nick;
@@ -54,6 +57,8 @@ namespace irc
 	class Buddy;
 	class Channel;
 	class DCC;
+	class TransferManager;
+	class Mask;
 
 	STREXCEPTION(IRCError);
 
@@ -74,12 +79,24 @@ namespace irc
 		User* user;
 		im::IM* im;
 		im::Auth *im_auth;
+		im::AuthWorker *auth_worker;
+		bool auth_trusted;          /**< password accepted by the auth cache */
+		vector<string> auth_input;  /**< lines received while authenticating */
 		map<string, Nick*> users;
+		multimap<string, Nick*> users_lc;  /**< users indexed by lower case nickname */
 		map<string, Channel*> channels;
 		map<string, Server*> servers;
-		vector<DCC*> dccs;
+		TransferManager* transfers;
 		vector<string> motd;
 
+		enum
+		{
+			MONITOR_CMD    = 1 << 0,  /**< nick added with MONITOR */
+			MONITOR_WATCH  = 1 << 1,  /**< nick added with WATCH */
+			MONITOR_ONLINE = 1 << 2   /**< last presence sent to user */
+		};
+		map<string, int> monitors;  /**< lower case nickname -> flags */
+
 		struct command_t
 		{
 			const char* cmd;
@@ -91,16 +108,31 @@ namespace irc
 		static command_t commands[];
 
 		void cleanUpNicks();
+		void unindexNick(Nick* nick);
 		void cleanUpChannels();
 		void cleanUpServers();
-		void cleanUpDCC();
 
 
 		/** Callback when it receives a new incoming message from socket. */
 		bool readIO(void*);
 
+		/** Handle a line received from the user. */
+		void parseLine(const string& line);
+
+		/** Callback when the auth worker has checked credentials. */
+		bool authenticated(void*);
+
 		bool check_channel_join(void*);
 
+		/** Send an ASCII-art icon in a WHOIS reply. */
+		void sendWhoisIcon(const string& nickname, string buf);
+
+		/** Callback when an icon asked by WHOIS is rendered. */
+		bool whoisIconRendered(void*);
+
+		/** Send the end of a WHOIS reply, after the icon. */
+		void endWhois(const string& nickname, bool extended_whois);
+
 		void m_nick(Message m);     /**< Handler for the NICK message */
 		void m_user(Message m);     /**< Handler for the USER message */
 		void m_pass(Message m);     /**< Handler for the PASS message */
@@ -132,6 +164,10 @@ namespace irc
 		void m_names(Message m);    /**< Handler for the NAMES message */
 		void m_topic(Message m);    /**< Handler for the TOPIC message */
 		void m_ison(Message m);     /**< Handler for the ISON message */
+		void m_monitor(Message m);  /**< Handler for the MONITOR message */
+		void m_watch(Message m);    /**< Handler for the WATCH message */
+		unsigned countMonitors(int flag) const;
+		void sendMonitorStatus(const string& nickname, int flags);
 		void m_invite(Message m);   /**< Handler for the INVITE message */
 		void m_kick(Message m);     /**< Handler for the KICK message */
 		void m_kill(Message m);     /**< Handler for the KILL message */
@@ -156,6 +192,9 @@ namespace irc
 		IRC(ServerPoll* poll, sock::SockWrapper* _sockw, string hostname, unsigned ping_freq);
 		~IRC();
 
+		/** Maximum number of MONITOR and WATCH entries. */
+		static const unsigned MONITOR_LIMIT = 100;
+
 		User* getUser() const { return user; }
 
 		virtual IRC* getIRC() const { return (IRC*)this; }
@@ -165,13 +204,26 @@ namespace irc
 		/** Ends the auth sequence.
 		 *
 		 * It checks if user has sent all requested parameters to
-		 * authenticate himself, and checks for password.
+		 * authenticate himself, and starts checking password, which
+		 * may take a while. Lines received meanwhile are handled once
+		 * it is done.
 		 *
 		 * If authentification success, it create the im::IM instance,
 		 * sends all welcome replies, create account servers, etc.
 		 */
 		void sendWelcome();
 
+		/** The master's auth cache answered about the credentials
+		 * being checked.
+		 *
+		 * @param result  previous result of these credentials
+		 * @param delay  if locked, seconds before the user may retry
+		 */
+		void authCached(im::AuthCache::result_t result, unsigned delay);
+
+		/** Tell the auth cache that the password has changed. */
+		void credentialsChanged();
+
 		/** User quits.
 		 *
 		 * @param reason  text used in the QUIT message
@@ -192,17 +244,34 @@ namespace irc
 		Buddy* getNick(const im::Buddy& buddy) const;
 		ConvNick* getNick(const im::Conversation& c) const;
 		vector<Nick*> matchNick(string pattern) const;
+		vector<Nick*> matchNick(const Mask& mask) const;
 		void removeNick(string nick);
 		void renameNick(Nick* n, string newnick);
 
+		/** Notify user if presence of a monitored nick has changed.
+		 *
+		 * It is called when nicks are added, removed or renamed, and
+		 * by im::Buddy::updated() when a buddy signs on or off.
+		 *
+		 * @param nickname  nickname to check
+		 */
+		void updateMonitor(const string& nickname);
+
 		void addServer(Server* server);
 		Server* getServer(string server) const;
 		void removeServer(string server);
 
 		DCC* createDCCSend(const im::FileTransfert& ft, Nick* from);
 		DCC* createDCCGet(Nick* from, string filename, uint32_t addr,
-				  uint16_t port, ssize_t size, _CallBack* callback);
+				  uint16_t port, ssize_t size, _CallBack* callback, bool resume = false);
+
+		/** IRC user accepted to resume a file he sends to a nick.
+		 *
+		 * @return  false if there isn't any transfer waiting for it.
+		 */
+		bool acceptDCCResume(Nick* from, uint16_t port, ssize_t position);
 		void updateDCC(const im::FileTransfert& ft, bool destroy = false);
+		TransferManager* getTransferManager() const { return transfers; }
 
 		/** Callback used by glibc to check user ping */
 		bool ping(void*);
@@ -0,0 +1,111 @@
+/*
+ * Minbif - IRC instant messaging gateway
+ * Copyright(C) 2009-2011 Romain Bignon
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <cstring>
+#include <fnmatch.h>
+
+#include "irc/mask.h"
+#include "irc/nick.h"
+#include "core/util.h"
+
+namespace irc {
+
+Mask::Mask(string pattern)
+{
+	if (pattern.find('!') == string::npos)
+	{
+		if (pattern.find('@') != string::npos)
+			pattern = "*!" + pattern;
+		else if (pattern.find(':') != string::npos)
+			pattern = "*!*@" + pattern;
+		else
+			pattern = pattern + "!*@*";
+	}
+	else if (pattern.find('@') == string::npos)
+		pattern += "@*";
+
+	size_t excl = pattern.find('!');
+	size_t at = pattern.find('@', excl);
+	nick = pattern.substr(0, excl);
+	if (at == string::npos)
+		ident = pattern.substr(excl + 1);
+	else
+	{
+		ident = pattern.substr(excl + 1, at - excl - 1);
+		host = pattern.substr(at + 1);
+	}
+
+	size_t i;
+
+	for(i = 0; i < nick.size() && !isWildcard(nick[i]); ++i)
+		;
+	nick_prefix = strlower(nick.substr(0, i));
+
+	for(i = host.size(); i > 0 && !isWildcard(host[i-1]); --i)
+		;
+	host_suffix = strlower(host.substr(i));
+
+	/* IM nicks have a hostname which is either "accid" or
+	 * "domain:accid". If the suffix contains the last field, or if
+	 * the whole host glob is literal, we know the account. */
+	if ((i = host_suffix.rfind(':')) != string::npos)
+		account = host_suffix.substr(i + 1);
+	else if (host_suffix.size() == host.size())
+		account = host_suffix;
+}
+
+bool Mask::isWildcard(char c)
+{
+	return strchr("*?[]", c) != NULL;
+}
+
+bool Mask::globMatch(const string& glob, const string& str)
+{
+	if (glob == "*")
+		return true;
+	return !fnmatch(glob.c_str(), str.c_str(), FNM_NOESCAPE|FNM_CASEFOLD);
+}
+
+bool Mask::matchNickname(const string& nickname) const
+{
+	if (nickname.size() < nick_prefix.size())
+		return false;
+	for(size_t i = 0; i < nick_prefix.size(); ++i)
+		if ((char)tolower(nickname[i]) != nick_prefix[i])
+			return false;
+
+	return globMatch(nick, nickname);
+}
+
+bool Mask::match(const string& nickname, const string& identname, const string& hostname) const
+{
+	if (hostname.size() < host_suffix.size())
+		return false;
+	for(size_t i = host_suffix.size(), j = hostname.size(); i > 0; --i, --j)
+		if ((char)tolower(hostname[j-1]) != host_suffix[i-1])
+			return false;
+
+	return matchNickname(nickname) && globMatch(ident, identname) && globMatch(host, hostname);
+}
+
+bool Mask::match(const Nick* n) const
+{
+	return match(n->getNickname(), n->getIdentname(), n->getHostname());
+}
+
+}; /* namespace irc */
@@ -0,0 +1,81 @@
+/*
+ * Minbif - IRC instant messaging gateway
+ * Copyright(C) 2009-2011 Romain Bignon
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef IRC_MASK_H
+#define IRC_MASK_H
+
+#include <string>
+
+namespace irc
+{
+	using std::string;
+
+	class Nick;
+
+	/** A compiled hostmask.
+	 *
+	 * The pattern is normalized to the "nick!ident@host" form and
+	 * split in three globs which are matched separately.
+	 *
+	 * Before calling fnmatch(), the literal prefix of the nickname
+	 * glob and the literal suffix of the hostname glob (usually
+	 * ":accountID") are compared, so most nicks are rejected without
+	 * building any string.
+	 */
+	class Mask
+	{
+		string nick, ident, host;
+
+		string nick_prefix;
+		string host_suffix;
+		string account;
+
+		static bool isWildcard(char c);
+		static bool globMatch(const string& glob, const string& str);
+
+	public:
+
+		/** Build the Mask object.
+		 *
+		 * @param pattern  a glob, which may lack the "!ident" or
+		 *                 "@host" parts.
+		 */
+		Mask(string pattern);
+
+		/** Normalized pattern. */
+		string getPattern() const { return nick + "!" + ident + "@" + host; }
+
+		/** Lower case literal part of the nickname glob, before
+		 * the first wildcard. Empty if the glob starts with one. */
+		string getNickPrefix() const { return nick_prefix; }
+
+		/** Account ID every matching IM nick belongs to, or an
+		 * empty string if the mask can match several accounts. */
+		string getAccountID() const { return account; }
+
+		/** Check if a nickname can match, without looking at the
+		 * ident and host parts. */
+		bool matchNickname(const string& nickname) const;
+
+		bool match(const string& nickname, const string& identname, const string& hostname) const;
+		bool match(const Nick* n) const;
+	};
+
+}; /* namespace irc */
+
+#endif /* IRC_MASK_H */
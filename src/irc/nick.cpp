@@ -94,6 +94,7 @@ string Nick::nickize(const string& n)
 void Nick::setNickname(string n)
 {
 	setName(n);
+	invalidateWhoCache();
 }
 
 void Nick::setIdentname(string n)
@@ -102,6 +103,7 @@ void Nick::setIdentname(string n)
 		if(*i == ' ')
 			*i = '_';
 	identname = n;
+	invalidateWhoCache();
 }
 
 void Nick::setHostname(string n)
@@ -110,6 +112,7 @@ void Nick::setHostname(string n)
 		if(*i == ' ')
 			*i = '.';
 	hostname = n;
+	invalidateWhoCache();
 }
 
 string Nick::getLongName() const
@@ -137,6 +140,12 @@ bool Nick::isOn(const Channel* chan) const
 	return false;
 }
 
+void Nick::invalidateWhoCache() const
+{
+	for(vector<ChanUser*>::const_iterator it = channels.begin(); it != channels.end(); ++it)
+		(*it)->getChannel()->invalidateWhoCache();
+}
+
 ChanUser* Nick::getChanUser(const Channel* chan) const
 {
 	for(vector<ChanUser*>::const_iterator it = channels.begin(); it != channels.end(); ++it)
@@ -182,6 +191,11 @@ void Nick::part(Channel* chan, string message)
 			++it;
 }
 
+void Nick::addChanUser(ChanUser* chanuser)
+{
+	channels.push_back(chanuser);
+}
+
 void Nick::removeChanUser(ChanUser* chanuser)
 {
 	for(vector<ChanUser*>::iterator it = channels.begin(); it != channels.end();)
@@ -92,6 +92,14 @@ namespace irc
 		 */
 		void part(Channel* chan, string message="");
 
+		/** Add a ChanUser to list, without any message.
+		 *
+		 * Used by Channel::addUsers().
+		 *
+		 * @param chanuser  ChanUser object
+		 */
+		void addChanUser(ChanUser* chanuser);
+
 		/** Remove an ChanUser from list.
 		 *
 		 * @param chanuser  ChanUser object
@@ -153,6 +161,12 @@ namespace irc
 		 */
 		ChanUser* getChanUser(const Channel* chan) const;
 
+		/** Drop WHO caches of every channel this user is on.
+		 *
+		 * Call it when something shown in a WHO reply changes.
+		 */
+		void invalidateWhoCache() const;
+
 		Server* getServer() const { return server; }
 
 		/** Get the full name representation of user.
@@ -171,7 +185,7 @@ namespace irc
 		void setHostname(string h);
 
 		virtual string getRealName() const { return realname; }
-		void setRealname(string r) { realname = r; }
+		void setRealname(string r) { realname = r; invalidateWhoCache(); }
 
 		virtual bool retrieveInfo() const { return false; }
 
@@ -184,7 +198,7 @@ namespace irc
 		void delFlag(unsigned flag) { flags &= ~flag; }
 		bool hasFlag(unsigned flag) const { return flags & flag; }
 
-		void setAwayMessage(string a) { away = a; }
+		void setAwayMessage(string a) { away = a; invalidateWhoCache(); }
 		virtual string getAwayMessage() const { return away; }
 		virtual bool isAway() const { return away.empty() == false; }
 		virtual bool isOnline() const { return true; }
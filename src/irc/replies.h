@@ -59,6 +59,7 @@
 #define RPL_VERSION          "351"
 #define RPL_WHOREPLY         "352"
 #define RPL_NAMREPLY         "353"
+#define RPL_WHOSPCRPL        "354"
 #define RPL_ENDOFNAMES       "366"
 #define RPL_BANLIST          "367"
 #define RPL_ENDOFBANLIST     "368"
@@ -70,6 +71,17 @@
 #define RPL_ENDOFMOTD        "376"
 #define RPL_YOUREOPER        "381"
 #define RPL_REHASHING        "382"
+#define RPL_LOGON            "600"
+#define RPL_LOGOFF           "601"
+#define RPL_WATCHOFF         "602"
+#define RPL_NOWON            "604"
+#define RPL_NOWOFF           "605"
+#define RPL_WATCHLIST        "606"
+#define RPL_ENDOFWATCHLIST   "607"
+#define RPL_MONONLINE        "730"
+#define RPL_MONOFFLINE       "731"
+#define RPL_MONLIST          "732"
+#define RPL_ENDOFMONLIST     "733"
 
 #define ERR_NOSUCHNICK       "401"
 #define ERR_NOSUCHCHANNEL    "403"
@@ -88,6 +100,8 @@
 #define ERR_NOPRIVILEGES     "481"
 #define ERR_CHANOPRIVSNEEDED "482"
 #define ERR_UMODEUNKNOWNFLAG "501"
+#define ERR_TOOMANYWATCH     "512"
+#define ERR_MONLISTFULL      "734"
 
 #define MSG_PRIVMSG          "PRIVMSG"
 #define MSG_NOTICE           "NOTICE"
@@ -114,6 +128,8 @@
 #define MSG_ADMIN            "ADMIN"
 #define MSG_LIST             "LIST"
 #define MSG_ISON             "ISON"
+#define MSG_MONITOR          "MONITOR"
+#define MSG_WATCH            "WATCH"
 #define MSG_INVITE           "INVITE"
 #define MSG_KICK             "KICK"
 #define MSG_KILL             "KILL"
@@ -127,5 +143,7 @@
 #define MSG_DIE              "DIE"
 #define MSG_OPER             "OPER"
 #define MSG_CMD              "CMD"
+#define MSG_AUTH             "AUTH"
+#define MSG_BANDWIDTH        "BANDWIDTH"
 
 #endif /* IRC_REPLIES_H */
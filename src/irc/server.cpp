@@ -27,17 +27,12 @@ Server::Server(string name, string _info)
 
 void Server::addNick(Nick* n)
 {
-	users.push_back(n);
+	users.insert(n);
 }
 
 void Server::removeNick(Nick* n)
 {
-	for(vector<Nick*>::iterator it = users.begin(); it != users.end(); ++it)
-		if (*it == n)
-		{
-			users.erase(it);
-			return;
-		}
+	users.erase(n);
 }
 
 unsigned Server::countNicks() const
@@ -48,7 +43,7 @@ unsigned Server::countNicks() const
 unsigned Server::countOnlineNicks() const
 {
 	unsigned i = 0;
-	for(vector<Nick*>::const_iterator it = users.begin(); it != users.end(); ++it)
+	for(set<Nick*>::const_iterator it = users.begin(); it != users.end(); ++it)
 		if((*it)->isOnline())
 			i++;
 	return i;
@@ -19,6 +19,7 @@
 #define IRC_SERVER_H
 
 #include <vector>
+#include <set>
 
 #include "core/entity.h"
 #include "im/account.h"
@@ -28,12 +29,13 @@ namespace irc
 	class IRC;
 	class Nick;
 	using std::vector;
+	using std::set;
 
 	/** This class represents an IRC server */
 	class Server : public Entity
 	{
 		string info;
-		vector<Nick*> users;
+		set<Nick*> users;
 
 	public:
 
@@ -50,6 +52,9 @@ namespace irc
 		void addNick(Nick* n);
 		void removeNick(Nick* n);
 
+		/** Get every nick which belongs to this server. */
+		set<Nick*> getNicks() const { return users; }
+
 		unsigned countNicks() const;
 		unsigned countOnlineNicks() const;
 
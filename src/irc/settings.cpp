@@ -38,7 +38,11 @@ string SettingPassword::getValue() const
 
 bool SettingPassword::setValue(string v)
 {
-	return getIRC()->getIMAuth()->setPassword(v);
+	if(!getIRC()->getIMAuth()->setPassword(v))
+		return false;
+
+	getIRC()->credentialsChanged();
+	return true;
 }
 
 string SettingTypingNotice::getValue() const
@@ -26,13 +26,94 @@
 #include "im/account.h"
 #include "core/util.h"
 #include "core/log.h"
+#include "core/callback.h"
 
 namespace irc {
 
 StatusChannel::StatusChannel(IRC* irc, string name)
-	: Channel(irc, name)
+	: Channel(irc, name),
+	  burst_cb(NULL),
+	  burst_id(-1),
+	  burst_dirty(false),
+	  burst_ticks(0)
 {}
 
+StatusChannel::~StatusChannel()
+{
+	if(burst_id >= 0)
+		g_source_remove(burst_id);
+	delete burst_cb;
+}
+
+void StatusChannel::startBurst()
+{
+	burst_dirty = true;
+	burst_ticks = 0;
+	if(burst_id >= 0)
+		return;
+
+	if(!burst_cb)
+		burst_cb = new CallBack<StatusChannel>(this, &StatusChannel::burst_check);
+	burst_id = g_timeout_add(BURST_QUIET, g_callback, burst_cb);
+}
+
+void StatusChannel::addBurstBuddy(const im::Buddy& buddy)
+{
+	burst_buddies.insert(buddy);
+	burst_dirty = true;
+}
+
+void StatusChannel::removeBurstBuddy(const im::Buddy& buddy)
+{
+	burst_buddies.erase(buddy);
+}
+
+bool StatusChannel::burst_check(void*)
+{
+	/* Wait until libpurple stops sending updates. */
+	if(burst_dirty && ++burst_ticks < BURST_MAX_TICKS)
+	{
+		burst_dirty = false;
+		return true;
+	}
+
+	burst_id = -1;
+	flushBurst();
+	return false;
+}
+
+void StatusChannel::flushBurst()
+{
+	if(burst_id >= 0)
+	{
+		g_source_remove(burst_id);
+		burst_id = -1;
+	}
+
+	set<im::Buddy> buddies;
+	buddies.swap(burst_buddies);
+
+	bool voiced = irc->getIM()->hasVoicedBuddies();
+	vector<std::pair<Nick*, int> > joins;
+	FOREACH(set<im::Buddy>, buddies, b)
+	{
+		im::Account account = b->getAccount();
+		if(!account.isConnected() || account.getStatusChannel() != this)
+			continue;
+
+		Buddy* n = b->getNick();
+		if(!n)
+			continue;
+
+		if(b->isOnline() && !n->isOn(this))
+			joins.push_back(std::make_pair((Nick*)n, b->isAvailable() && voiced ? ChanUser::VOICE : 0));
+		else
+			b->updated();
+	}
+
+	addUsers(joins);
+}
+
 void StatusChannel::addAccount(const im::Account& account)
 {
 	accounts.push_back(account);
@@ -20,23 +20,41 @@
 #define IRC_STATUS_CHANNEL_H
 
 #include <vector>
+#include <set>
 
 #include "channel.h"
 #include "im/account.h"
+#include "im/buddy.h"
+
+class _CallBack;
 
 namespace irc
 {
 	using std::vector;
+	using std::set;
 
 	class StatusChannel : public Channel
 	{
 		vector<im::Account> accounts;
 
+		/* Burst: while an account signs on, buddy updates are
+		 * collected and applied at once after a quiet period. */
+		set<im::Buddy> burst_buddies;
+		_CallBack* burst_cb;
+		int burst_id;
+		bool burst_dirty;
+		unsigned burst_ticks;
+
+		static const unsigned BURST_QUIET = 500;   /**< ms without update before flush */
+		static const unsigned BURST_MAX_TICKS = 20; /**< flush anyway after this many periods */
+
 		string getMaskFromName(const string& name, const im::Account& acc) const;
 
+		bool burst_check(void*);
+
 	public:
 		StatusChannel(IRC* irc, string name);
-		virtual ~StatusChannel() {}
+		virtual ~StatusChannel();
 
 		virtual bool isStatusChannel() const { return true; }
 		virtual bool isRemoteChannel() const { return false; }
@@ -45,6 +63,28 @@ namespace irc
 		void removeAccount(const im::Account& account);
 		size_t countAccounts() const { return accounts.size(); }
 
+		/** Start a burst, or extend the current one.
+		 *
+		 * Called when an account connects. Until the burst is
+		 * flushed, im::Buddy::updated() gives buddies to
+		 * addBurstBuddy() instead of sending JOIN and MODE messages.
+		 */
+		void startBurst();
+		bool inBurst() const { return burst_id >= 0; }
+
+		/** Remember that a buddy has changed during burst. */
+		void addBurstBuddy(const im::Buddy& buddy);
+
+		/** Forget a buddy, for example when it is removed. */
+		void removeBurstBuddy(const im::Buddy& buddy);
+
+		/** Apply every pending change now.
+		 *
+		 * New online buddies are added with Channel::addUsers(), and
+		 * the other ones go through im::Buddy::updated().
+		 */
+		void flushBurst();
+
 		virtual bool invite(Nick* from, const string& nickname, const string& message);
 		virtual bool kick(ChanUser* from, ChanUser* victim, const string& message);
 		virtual bool setTopic(Entity* who, const string& message);
@@ -0,0 +1,267 @@
+/*
+ * Minbif - IRC instant messaging gateway
+ * Copyright(C) 2009-2010 Romain Bignon
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "irc/transfer_manager.h"
+#include "irc/dcc.h"
+#include "irc/message.h"
+#include "irc/replies.h"
+#include "im/ft.h"
+#include "server_poll/poll.h"
+#include "core/config.h"
+
+namespace irc {
+
+TransferManager::TransferManager(ServerPoll* _poll)
+	: poll(_poll),
+	  user_rate(0),
+	  global_rate(0),
+	  shares(1),
+	  sending(false),
+	  timer_id(0)
+{
+	g_get_current_time(&user_bucket.last);
+	global_bucket.last = last_sample = user_bucket.last;
+	user_bucket.tokens = global_bucket.tokens = 0;
+
+	rehash();
+}
+
+TransferManager::~TransferManager()
+{
+	if(timer_id)
+		g_source_remove(timer_id);
+	clear();
+}
+
+void TransferManager::rehash()
+{
+	ConfigSection* section = conf.GetSection("file_transfers");
+	user_rate = section->GetItem("user_bandwidth")->Integer() * 1024;
+	global_rate = section->GetItem("global_bandwidth")->Integer() * 1024;
+}
+
+void TransferManager::add(DCC* dcc)
+{
+	dcc->setManager(this);
+	dccs.push_back(dcc);
+
+	im::FileTransfert ft = dcc->getFileTransfert();
+	if(ft.isValid())
+		xfers[ft.getPurpleXfer()] = dcc;
+
+	Sample& s = samples[dcc];
+	s.bytes = dcc->getBytesTransferred();
+	s.rate = 0;
+
+	if(!timer_id)
+	{
+		g_get_current_time(&last_sample);
+		timer_id = g_timeout_add(TICK, TransferManager::tick, this);
+	}
+}
+
+void TransferManager::update(const im::FileTransfert& ft, bool destroy)
+{
+	map<PurpleXfer*, DCC*>::iterator it = xfers.find(ft.getPurpleXfer());
+	if(it == xfers.end())
+		return;
+
+	DCC* dcc = it->second;
+	if(destroy)
+		xfers.erase(it);
+	if(!dcc->isFinished())
+		dcc->updated(destroy);
+}
+
+bool TransferManager::acceptResume(Nick* from, uint16_t port, ssize_t position)
+{
+	for(vector<DCC*>::iterator it = dccs.begin(); it != dccs.end(); ++it)
+	{
+		DCCGet* dcc = dynamic_cast<DCCGet*>(*it);
+		if(dcc && !dcc->isFinished() && dcc->getPeer() == from && dcc->accept(port, position))
+			return true;
+	}
+	return false;
+}
+
+void TransferManager::removePeers(const set<Nick*>& nicks)
+{
+	for(vector<DCC*>::iterator it = dccs.begin(); it != dccs.end(); ++it)
+		if(!(*it)->isFinished() && nicks.find((*it)->getPeer()) != nicks.end())
+			(*it)->setPeer(NULL);
+}
+
+void TransferManager::clear()
+{
+	for(vector<DCC*>::iterator it = dccs.begin(); it != dccs.end(); ++it)
+		delete *it;
+
+	dccs.clear();
+	xfers.clear();
+	samples.clear();
+	throttled.clear();
+}
+
+void TransferManager::purge()
+{
+	for(vector<DCC*>::iterator it = dccs.begin(); it != dccs.end();)
+	{
+		DCC* dcc = *it;
+		if(!dcc->isFinished())
+		{
+			++it;
+			continue;
+		}
+
+		im::FileTransfert ft = dcc->getFileTransfert();
+		if(ft.isValid())
+			xfers.erase(ft.getPurpleXfer());
+		samples.erase(dcc);
+		throttled.erase(dcc);
+		delete dcc;
+		it = dccs.erase(it);
+	}
+}
+
+void TransferManager::refill(Bucket& bucket, size_t rate)
+{
+	GTimeVal now;
+	g_get_current_time(&now);
+
+	double elapsed = (now.tv_sec - bucket.last.tv_sec) + (now.tv_usec - bucket.last.tv_usec) / 1000000.0;
+	bucket.last = now;
+	if(elapsed <= 0)
+		return;
+
+	/* One second of burst. */
+	bucket.tokens += elapsed * rate;
+	if(bucket.tokens > rate)
+		bucket.tokens = rate;
+}
+
+size_t TransferManager::allowance(DCC* dcc, size_t wanted)
+{
+	size_t allowed = wanted;
+	size_t global_share = global_rate / (shares ? shares : 1);
+
+	if(user_rate)
+	{
+		refill(user_bucket, user_rate);
+		if(user_bucket.tokens < allowed)
+			allowed = user_bucket.tokens > 0 ? (size_t)user_bucket.tokens : 0;
+	}
+	if(global_share)
+	{
+		refill(global_bucket, global_share);
+		if(global_bucket.tokens < allowed)
+			allowed = global_bucket.tokens > 0 ? (size_t)global_bucket.tokens : 0;
+	}
+
+	if(allowed < wanted)
+		throttled.insert(dcc);
+
+	return allowed;
+}
+
+void TransferManager::consume(size_t bytes)
+{
+	if(user_rate)
+		user_bucket.tokens -= bytes;
+	if(global_rate)
+		global_bucket.tokens -= bytes;
+}
+
+void TransferManager::setShares(unsigned _shares)
+{
+	shares = _shares ? _shares : 1;
+}
+
+void TransferManager::setSending(bool _sending)
+{
+	if(sending == _sending)
+		return;
+
+	sending = _sending;
+	poll->ipc_send(Message(MSG_BANDWIDTH).addArg(sending ? "ACTIVE" : "IDLE"));
+}
+
+double TransferManager::getRate(DCC* dcc) const
+{
+	map<DCC*, Sample>::const_iterator it = samples.find(dcc);
+	return it != samples.end() ? it->second.rate : 0;
+}
+
+double TransferManager::getTotalRate() const
+{
+	double rate = 0;
+	for(map<DCC*, Sample>::const_iterator it = samples.begin(); it != samples.end(); ++it)
+		rate += it->second.rate;
+	return rate;
+}
+
+void TransferManager::sample()
+{
+	GTimeVal now;
+	g_get_current_time(&now);
+	double elapsed = (now.tv_sec - last_sample.tv_sec) + (now.tv_usec - last_sample.tv_usec) / 1000000.0;
+	if(elapsed * 1000 < SAMPLE_PERIOD)
+		return;
+	last_sample = now;
+
+	purge();
+
+	bool has_send = false;
+	for(vector<DCC*>::iterator it = dccs.begin(); it != dccs.end(); ++it)
+	{
+		Sample& s = samples[*it];
+		size_t bytes = (*it)->getBytesTransferred();
+
+		/* Smooth the rate on the last few seconds. */
+		double rate = bytes > s.bytes ? (bytes - s.bytes) / elapsed : 0;
+		s.rate = s.rate * 0.5 + rate * 0.5;
+		s.bytes = bytes;
+
+		if(dynamic_cast<DCCSend*>(*it))
+			has_send = true;
+	}
+
+	setSending(has_send);
+}
+
+gboolean TransferManager::tick(gpointer data)
+{
+	TransferManager* manager = static_cast<TransferManager*>(data);
+
+	/* Wake up throttled transfers, they may throttle again. */
+	set<DCC*> wake;
+	wake.swap(manager->throttled);
+	for(set<DCC*>::iterator it = wake.begin(); it != wake.end(); ++it)
+		if(!(*it)->isFinished())
+			(*it)->updated(false);
+
+	manager->sample();
+
+	if(manager->dccs.empty())
+	{
+		manager->timer_id = 0;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+}; /* namespace irc */
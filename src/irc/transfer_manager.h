@@ -0,0 +1,150 @@
+/*
+ * Minbif - IRC instant messaging gateway
+ * Copyright(C) 2009-2010 Romain Bignon
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef IRC_TRANSFER_MANAGER_H
+#define IRC_TRANSFER_MANAGER_H
+
+#include <purple.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <map>
+#include <set>
+#include <vector>
+
+class ServerPoll;
+
+namespace im
+{
+	class FileTransfert;
+};
+
+namespace irc
+{
+	using std::map;
+	using std::set;
+	using std::vector;
+
+	class DCC;
+	class Nick;
+
+	/** Keep track of the DCC transfers of the IRC user.
+	 *
+	 * Transfers are indexed by their libpurple xfer, so progress
+	 * updates do not walk the whole list, and finished transfers are
+	 * purged by a timer.
+	 *
+	 * Files sent to the IRC user are shaped with two token buckets:
+	 * one for this user, and one for the global limit, which is
+	 * shared with the other minbif users currently sending files (the
+	 * daemon master tells how many they are).
+	 */
+	class TransferManager
+	{
+		struct Bucket
+		{
+			double tokens;
+			GTimeVal last;
+		};
+
+		struct Sample
+		{
+			size_t bytes;
+			double rate;          /**< bytes/s */
+		};
+
+		ServerPoll* poll;
+		vector<DCC*> dccs;
+		map<PurpleXfer*, DCC*> xfers;
+		map<DCC*, Sample> samples;
+		set<DCC*> throttled;   /**< waiting for tokens */
+		Bucket user_bucket;
+		Bucket global_bucket;
+		size_t user_rate;      /**< bytes/s, 0 for no limit */
+		size_t global_rate;    /**< bytes/s, 0 for no limit */
+		unsigned shares;       /**< users sharing the global limit */
+		bool sending;          /**< the master knows we are sending files */
+		GTimeVal last_sample;
+		guint timer_id;
+
+		static const unsigned TICK = 100;          /**< ms */
+		static const unsigned SAMPLE_PERIOD = 1000; /**< ms */
+
+		static void refill(Bucket& bucket, size_t rate);
+		static gboolean tick(gpointer data);
+		void sample();
+		void purge();
+		void setSending(bool sending);
+
+	public:
+
+		TransferManager(ServerPoll* poll);
+		~TransferManager();
+
+		/** Read limits from configuration. */
+		void rehash();
+
+		/** Take the ownership of a new transfer. */
+		void add(DCC* dcc);
+
+		/** libpurple has updated a transfer.
+		 *
+		 * @param ft  file transfer
+		 * @param destroy  the xfer is destroyed
+		 */
+		void update(const im::FileTransfert& ft, bool destroy);
+
+		/** IRC user accepted to resume a file he sends to a nick.
+		 *
+		 * @return  false if there isn't any transfer waiting for it.
+		 */
+		bool acceptResume(Nick* from, uint16_t port, ssize_t position);
+
+		/** These nicks are removed, forget them in transfers. */
+		void removePeers(const set<Nick*>& nicks);
+
+		/** Delete every transfer. */
+		void clear();
+
+		/** Get how many bytes a transfer is allowed to send now.
+		 *
+		 * If it is less than wanted, the transfer is woken up with
+		 * DCC::updated() when tokens are available.
+		 */
+		size_t allowance(DCC* dcc, size_t wanted);
+
+		/** A transfer has sent some bytes. */
+		void consume(size_t bytes);
+
+		/** Count of users sharing the global limit. */
+		void setShares(unsigned shares);
+
+		const vector<DCC*>& getDCCs() const { return dccs; }
+		size_t getUserRate() const { return user_rate; }
+		size_t getGlobalRate() const { return global_rate; }
+		unsigned getShares() const { return shares; }
+
+		/** Current rate of a transfer, in bytes/s. */
+		double getRate(DCC* dcc) const;
+
+		/** Current rate of every transfers, in bytes/s. */
+		double getTotalRate() const;
+	};
+
+}; /* namespace irc */
+
+#endif /* IRC_TRANSFER_MANAGER_H */
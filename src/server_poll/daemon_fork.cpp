@@ -30,6 +30,7 @@
 #include "irc/user.h"
 #include "irc/message.h"
 #include "irc/replies.h"
+#include "irc/transfer_manager.h"
 #include "core/callback.h"
 #include "core/log.h"
 #include "core/minbif.h"
@@ -234,6 +235,7 @@ bool DaemonForkServerPoll::new_client_cb(void*)
 				g_source_remove(child->read_id);
 				delete child;
 			}
+			auth_queue.clear();
 		}
 
 		try
@@ -257,6 +259,8 @@ DaemonForkServerPoll::ipc_cmds_t DaemonForkServerPoll::ipc_cmds[] = {
 	{ MSG_DIE,        &DaemonForkServerPoll::m_die,      2 },
 	{ MSG_OPER,       &DaemonForkServerPoll::m_oper,     1 },
 	{ MSG_USER,       &DaemonForkServerPoll::m_user,     1 },
+	{ MSG_AUTH,       &DaemonForkServerPoll::m_auth,     2 },
+	{ MSG_BANDWIDTH,  &DaemonForkServerPoll::m_bandwidth, 1 },
 };
 
 /** OPER nick
@@ -325,6 +329,168 @@ void DaemonForkServerPoll::m_user(child_t* child, irc::Message m)
 	}
 }
 
+/** AUTH CHECK username digest
+ *  AUTH CHECK username result delay
+ *  AUTH VALID|INVALID username digest
+ *  AUTH DONE username
+ *  AUTH FORGET username
+ *
+ * Children ask the master's auth cache before checking a password,
+ * and tell it the result. Only the result for the user and digest
+ * of the last CHECK is accepted from a child.
+ *
+ * When the child has to check the password itself, the answer is
+ * delayed until less than MAX_AUTH_RUNNING children are checking
+ * one, until they send DONE or leave.
+ */
+void DaemonForkServerPoll::m_auth(child_t* child, irc::Message m)
+{
+	string cmd = m.getArg(0);
+	string username = m.getArg(1);
+
+	if(!child)
+	{
+		if(irc && cmd == "CHECK" && m.countArgs() >= 4)
+			irc->authCached(im::AuthCache::resultFromString(m.getArg(2)), s2t<unsigned>(m.getArg(3)));
+		return;
+	}
+
+	if(cmd == "DONE")
+	{
+		releaseAuth(child);
+		return;
+	}
+
+	if(cmd == "FORGET")
+	{
+		if(!strcasecmp(username.c_str(), child->username.c_str()))
+			auth_cache.forget(username);
+		return;
+	}
+
+	if(m.countArgs() < 3)
+	{
+		b_log[W_WARNING] << "Received malformated AUTH command from IPC";
+		return;
+	}
+
+	string digest = m.getArg(2);
+	if(cmd == "CHECK")
+	{
+		unsigned delay = 0;
+		im::AuthCache::result_t result = auth_cache.check(username, digest, &delay);
+
+		/* A client retrying a wrong password is counted too. */
+		if(result == im::AuthCache::INVALID)
+			auth_cache.failure(username, digest);
+
+		child->auth_username = username;
+		child->auth_digest = digest;
+		releaseAuth(child);
+
+		if(result == im::AuthCache::UNKNOWN)
+		{
+			auth_queue.push_back(child);
+			startAuth();
+		}
+		else
+			ipc_master_send(child, irc::Message(MSG_AUTH).addArg("CHECK")
+					                             .addArg(username)
+					                             .addArg(im::AuthCache::resultToString(result))
+					                             .addArg(t2s(delay)));
+		return;
+	}
+
+	if(child->auth_username.empty() || child->auth_username != username || child->auth_digest != digest)
+	{
+		b_log[W_WARNING] << "IPC: unexpected authentication result for " << username;
+		return;
+	}
+	child->auth_username.clear();
+	child->auth_digest.clear();
+	releaseAuth(child);
+
+	if(cmd == "VALID")
+		auth_cache.success(username, digest);
+	else if(cmd == "INVALID")
+	{
+		auth_cache.failure(username, digest);
+		b_log[W_INFO] << "Authentication failed for " << username;
+	}
+}
+
+/** BANDWIDTH ACTIVE|IDLE
+ *  BANDWIDTH SHARES count
+ *
+ * Children tell when they start or stop sending files with DCC, and
+ * the master tells them how many users share the global bandwidth.
+ */
+void DaemonForkServerPoll::m_bandwidth(child_t* child, irc::Message m)
+{
+	if(!child)
+	{
+		if(irc && m.getArg(0) == "SHARES" && m.countArgs() >= 2)
+			irc->getTransferManager()->setShares(s2t<unsigned>(m.getArg(1)));
+		return;
+	}
+
+	bool sending = (m.getArg(0) == "ACTIVE");
+	if(sending == child->sending)
+		return;
+
+	child->sending = sending;
+	shareBandwidth();
+}
+
+void DaemonForkServerPoll::startAuth()
+{
+	unsigned running = 0;
+	for(vector<child_t*>::iterator it = childs.begin(); it != childs.end(); ++it)
+		if((*it)->auth_running)
+			running++;
+
+	while(running < MAX_AUTH_RUNNING && !auth_queue.empty())
+	{
+		child_t* child = auth_queue.front();
+		auth_queue.pop_front();
+
+		child->auth_running = true;
+		running++;
+		ipc_master_send(child, irc::Message(MSG_AUTH).addArg("CHECK")
+				                             .addArg(child->auth_username)
+				                             .addArg(im::AuthCache::resultToString(im::AuthCache::UNKNOWN))
+				                             .addArg("0"));
+	}
+}
+
+void DaemonForkServerPoll::releaseAuth(child_t* child)
+{
+	for(deque<child_t*>::iterator it = auth_queue.begin(); it != auth_queue.end();)
+		if(*it == child)
+			it = auth_queue.erase(it);
+		else
+			++it;
+
+	if(!child->auth_running)
+		return;
+
+	child->auth_running = false;
+	startAuth();
+}
+
+void DaemonForkServerPoll::shareBandwidth()
+{
+	unsigned count = 0;
+	for(vector<child_t*>::iterator it = childs.begin(); it != childs.end(); ++it)
+		if((*it)->sending)
+			count++;
+
+	for(vector<child_t*>::iterator it = childs.begin(); it != childs.end(); ++it)
+		if((*it)->sending)
+			ipc_master_send(*it, irc::Message(MSG_BANDWIDTH).addArg("SHARES")
+					                                .addArg(t2s(count)));
+}
+
 bool DaemonForkServerPoll::ipc_read(void* data)
 {
 	child_t* child = NULL;
@@ -351,10 +517,15 @@ bool DaemonForkServerPoll::ipc_read(void* data)
 				else
 					++it;
 
+			bool sending = child->sending;
+			releaseAuth(child);
 			close(child->fd);
 			g_source_remove(child->read_id);
 			delete child->read_cb;
 			delete child;
+
+			if(sending)
+				shareBandwidth();
 		}
 		else
 		{
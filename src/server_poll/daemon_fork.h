@@ -20,8 +20,10 @@
 #define SERVER_POLL_DAEMON_FORK_H
 
 #include <vector>
+#include <deque>
 
 #include "poll.h"
+#include "im/auth_cache.h"
 
 namespace irc {
 	class IRC;
@@ -30,6 +32,7 @@ namespace irc {
 
 class _CallBack;
 using std::vector;
+using std::deque;
 
 class DaemonForkServerPoll : public ServerPoll
 {
@@ -40,6 +43,10 @@ class DaemonForkServerPoll : public ServerPoll
 		int read_id;
 		_CallBack* read_cb;
 		string username;
+		string auth_username;  /**< user checked in the auth cache */
+		string auth_digest;    /**< and the digest given with CHECK */
+		bool auth_running;     /**< checking a password */
+		bool sending;          /**< files are sent to this user with DCC */
 	};
 
 	/** IPC commands array. */
@@ -65,6 +72,8 @@ class DaemonForkServerPoll : public ServerPoll
 	void m_die(child_t* child, irc::Message m);         /**< IPC handler for the DIE command. */
 	void m_oper(child_t* child, irc::Message m);        /**< IPC handler for the OPER command. */
 	void m_user(child_t* child, irc::Message m);        /**< IPC handler for the USER command. */
+	void m_auth(child_t* child, irc::Message m);        /**< IPC handler for the AUTH command. */
+	void m_bandwidth(child_t* child, irc::Message m);   /**< IPC handler for the BANDWIDTH command. */
 
 	irc::IRC* irc;
 	int maxcon;
@@ -72,9 +81,24 @@ class DaemonForkServerPoll : public ServerPoll
 	int read_id;
 	_CallBack *read_cb;
 	vector<child_t*> childs;
+	im::AuthCache auth_cache;  /**< only used by master */
+	deque<child_t*> auth_queue; /**< children waiting to check a password */
+
+	/** Password checks (PAM...) running at the same time. */
+	static const unsigned MAX_AUTH_RUNNING = 2;
 
 	bool ipc_read(void*);
 
+	/** Tell children sending files how many they are. */
+	void shareBandwidth();
+
+	/** Let waiting children check their password, if there are
+	 * free slots. */
+	void startAuth();
+
+	/** A child doesn't check a password anymore. */
+	void releaseAuth(child_t* child);
+
 	/** Master sends a IPC message to a child.
 	 *
 	 * @param child  child data structure
@@ -0,0 +1,99 @@
+# -*- coding: utf-8 -*-
+
+"""
+Minbif - IRC instant messaging gateway
+Copyright(C) 2009 Romain Bignon
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+"""
+
+import sys
+from time import time
+
+import config
+from test import Test, Instance
+
+class TestConversationChurn(Test):
+    """
+    Measure how fast minbif follows people joining and leaving a chat
+    room: minbif2 joins and parts a XMPP MUC where minbif1 is, which
+    drives Conversation::add_users() and Conversation::remove_user()
+    on minbif1.
+
+    The MUC service is 'conference.' followed by the account's domain,
+    unless MUC_SERVICE is set in config.py.
+    """
+    NAME = 'conversation_churn'
+    INSTANCES = {'minbif1': Instance(), 'minbif2': Instance()}
+    TESTS = ['init', 'join', 'churn']
+    ROOM = 'minbif-tests-churn'
+    CYCLES = 50
+    TIMEOUT = 10
+
+    def test_init(self):
+        for name in ('minbif1', 'minbif2'):
+            if not self[name].create_account('jabber', channel='&minbif'): return False
+            if not self[name].wait_connected('jabber'): return False
+        return True
+
+    def get_channel(self, name):
+        acc = self[name].get_accounts()['jabber']
+        service = getattr(config, 'MUC_SERVICE', 'conference.%s' % acc.username.split('@')[-1].split('/')[0])
+        return '#%s@%s:jabber' % (self.ROOM, service)
+
+    def wait_chan_msg(self, name, cmd, me):
+        """
+        Wait for a JOIN or a PART, sent by the IRC user if me is True,
+        or by someone else. Returns the channel name.
+        """
+        while 1:
+            msg = self[name].readmsg(cmd, self.TIMEOUT)
+            if not msg:
+                return None
+            if msg.sender.startswith('minbif!') == me:
+                return msg.receiver.lstrip(':')
+
+    def test_join(self):
+        self['minbif1'].write('JOIN %s' % self.get_channel('minbif1'))
+        self.chan1 = self.wait_chan_msg('minbif1', 'JOIN', True)
+        if not self.chan1:
+            return False
+        return self['minbif1'].readmsg('366', self.TIMEOUT) != None
+
+    def test_churn(self):
+        channel = self.get_channel('minbif2')
+        while self['minbif1'].readline(): pass
+
+        start = time()
+        for i in xrange(self.CYCLES):
+            self['minbif2'].write('JOIN %s' % channel)
+            chan2 = self.wait_chan_msg('minbif2', 'JOIN', True)
+            if not chan2: return False
+            if self.wait_chan_msg('minbif1', 'JOIN', False) != self.chan1: return False
+
+            self['minbif2'].write('PART %s' % chan2)
+            if not self.wait_chan_msg('minbif2', 'PART', True): return False
+            if self.wait_chan_msg('minbif1', 'PART', False) != self.chan1: return False
+
+        elapsed = time() - start
+        self['minbif1'].log('%d join/part cycles in %.3fs' % (self.CYCLES, elapsed))
+        sys.stdout.write('(%.1f ms/cycle) ' % (elapsed * 1000 / self.CYCLES))
+        return True
+
+if __name__ == '__main__':
+    test = TestConversationChurn()
+    if test.run():
+        sys.exit(0)
+    else:
+        sys.exit(1)